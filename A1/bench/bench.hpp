@@ -0,0 +1,64 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "../src/a1.hpp"
+#include "../src/alloc.hpp"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Shared setup and timing of the benchmarks of the software rasterizer. Benchmarks render
+// offscreen, so they run without a display.
+namespace Bench {
+
+	namespace R = COL781::Software;
+
+	// Initializes the rasterizer to render offscreen at the given size.
+	inline bool initialize(R::Rasterizer &r, int width, int height) {
+		if (r.initializeOffscreen(width, height))
+			return true;
+		std::cerr << "Could not initialize an offscreen rasterizer" << std::endl;
+		return false;
+	}
+
+	struct Mode {
+		// One of the variants that a benchmark compares
+		std::string name;
+		int frames;                      // frames timed in every round
+		std::function<void()> setup;     // if set, called before every round of the mode
+		std::function<void()> frame;     // renders one frame
+	};
+
+	struct Timing {
+		double ms;             // best time per frame over the rounds, in milliseconds
+		double allocations;    // heap allocations per frame, or -1 if not counted (see allocationCount())
+	};
+
+	// Times the modes over the given number of rounds. The modes take turns, and each keeps its
+	// best round, to even out noise from the machine. Every round starts with one frame of warm-up.
+	inline std::vector<Timing> run(const std::vector<Mode> &modes, int rounds) {
+		std::vector<Timing> timings(modes.size());
+		for (int round = 0; round < rounds; round++) {
+			for (size_t m = 0; m < modes.size(); m++) {
+				const Mode &mode = modes[m];
+				if (mode.setup)
+					mode.setup();
+				mode.frame();
+				long long allocated = R::allocationCount();
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int frame = 0; frame < mode.frames; frame++)
+					mode.frame();
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()/mode.frames;
+				if (round == 0 || ms < timings[m].ms)
+					timings[m].ms = ms;
+				timings[m].allocations = allocated < 0 ? -1 : (double)(R::allocationCount() - allocated)/mode.frames;
+			}
+		}
+		return timings;
+	}
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "bench.hpp"
+#include <iostream>
+#include <vector>
+// Benchmark of the depth formats of the software rasterizer on a scene with heavy overdraw:
+// full-screen layers of jagged terrain, whose depths vary too much within every 8x8 block for
+// the Hi-Z bounds to decide the depth test, drawn in neither front-to-back nor back-to-front order.
+namespace R = COL781::Software;
+using namespace glm;
+
+// A pseudo-random number in [-1, 1] for the given integers.
+float noise(int x, int y, int z) {
+	unsigned h = (unsigned)x*73856093u ^ (unsigned)y*19349663u ^ (unsigned)z*83492791u;
+	h ^= h >> 13; h *= 0x5bd1e995u; h ^= h >> 15;
+	return (h & 0xffff)/32767.5f - 1.0f;
+}
+
+int main() {
+	R::Rasterizer r;
+	int width = 1920, height = 1080;
+	if (!Bench::initialize(r, width, height))
+		return EXIT_FAILURE;
+	R::ShaderProgram program = r.createShaderProgram(
+		r.vsColor(),
+		r.fsIdentity()
+	);
+	const int nLayers = 16, nx = 60, ny = 34;   // cells of about 32x32 pixels
+	R::Object layers[nLayers];
+	std::vector<vec4> vertices((nx+1)*(ny+1)), colors((nx+1)*(ny+1));
+	std::vector<ivec3> triangles;
+	for (int y = 0; y < ny; y++)
+		for (int x = 0; x < nx; x++) {
+			int v = x + (nx+1)*y;
+			triangles.push_back(ivec3(v, v+1, v+nx+1));
+			triangles.push_back(ivec3(v+1, v+nx+2, v+nx+1));
+		}
+	for (int k = 0; k < nLayers; k++) {
+		float base = -0.6f + 1.2f*((k*5) % nLayers)/nLayers;
+		for (int y = 0; y <= ny; y++)
+			for (int x = 0; x <= nx; x++) {
+				int v = x + (nx+1)*y;
+				vertices[v] = vec4(2.0f*x/nx - 1, 2.0f*y/ny - 1, base + 0.3f*noise(x, y, k), 1.0);
+				colors[v] = vec4((float)k/nLayers, 0.5f + 0.5f*noise(y, x, k), 1.0f - (float)k/nLayers, 1.0);
+			}
+		layers[k] = r.createObject();
+		r.setVertexAttribs(layers[k], 0, (int)vertices.size(), vertices.data());
+		r.setVertexAttribs(layers[k], 1, (int)colors.size(), colors.data());
+		r.setTriangleIndices(layers[k], (int)triangles.size(), triangles.data());
+	}
+	r.enableDepthTest();
+	r.useShaderProgram(program);
+
+	struct Format { R::DepthFormat format; const char *name; int bytes; };
+	Format formats[] = {
+		{R::DepthFormat::D32F, "D32F", 4},
+		{R::DepthFormat::D24, "D24", 4},
+		{R::DepthFormat::D16, "D16", 2}
+	};
+	const int nFormats = 3;
+	R::Stats stats[nFormats];
+	std::vector<Bench::Mode> modes;
+	for (int f = 0; f < nFormats; f++) {
+		Bench::Mode mode;
+		mode.name = formats[f].name;
+		mode.frames = 5;
+		mode.setup = [&r, &formats, f]() { r.setDepthFormat(formats[f].format); };
+		mode.frame = [&r, &layers, &stats, f]() {
+			r.clear(vec4(0.0, 0.0, 0.0, 1.0));
+			for (int k = 0; k < nLayers; k++)
+				r.drawObject(layers[k]);
+			stats[f] = r.getStats();
+		};
+		modes.push_back(mode);
+	}
+	std::vector<Bench::Timing> timings = Bench::run(modes, 5);
+	for (int f = 0; f < nFormats; f++) {
+		std::cout << formats[f].name << ": " << timings[f].ms << " ms/frame, speedup " << timings[0].ms/timings[f].ms
+		          << ", depth buffer " << (double)width*height*formats[f].bytes/(1 << 20) << " MiB"
+		          << ", fragments shaded " << stats[f].fragmentsShaded
+		          << ", killed early " << stats[f].fragmentsKilledEarly << std::endl;
+	}
+	r.deleteShaderProgram(program);
+	return EXIT_SUCCESS;
+}
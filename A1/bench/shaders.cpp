@@ -0,0 +1,81 @@
+#include "bench.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+// Benchmark of the shader calls of the software rasterizer: draws a mesh with the built-in
+// vsColorTransform and fsIdentity, through the active program's function pointers and through
+// drawObject<VSColorTransform, FSIdentity>(), which inlines them. The mesh is drawn whole, then
+// with its vertices only, to time the vertex stage where the shaders run.
+namespace R = COL781::Software;
+using namespace glm;
+
+int main() {
+	R::Rasterizer r;
+	int width = 1920, height = 1080;
+	if (!Bench::initialize(r, width, height))
+		return EXIT_FAILURE;
+	R::ShaderProgram program = r.createShaderProgram(
+		r.vsColorTransform(),
+		r.fsIdentity()
+	);
+	const int nx = 512, ny = 288;   // cells of about 4x4 pixels
+	std::vector<vec4> vertices((nx+1)*(ny+1)), colors((nx+1)*(ny+1));
+	std::vector<ivec3> triangles;
+	for (int y = 0; y <= ny; y++)
+		for (int x = 0; x <= nx; x++) {
+			int v = x + (nx+1)*y;
+			vertices[v] = vec4(2.0f*x/nx - 1, 2.0f*y/ny - 1, 0.5f*x/nx - 0.25f, 1.0);
+			colors[v] = vec4((float)x/nx, (float)y/ny, 0.5, 1.0);
+		}
+	for (int y = 0; y < ny; y++)
+		for (int x = 0; x < nx; x++) {
+			int v = x + (nx+1)*y;
+			triangles.push_back(ivec3(v, v+1, v+nx+1));
+			triangles.push_back(ivec3(v+1, v+nx+2, v+nx+1));
+		}
+	R::Object mesh = r.createObject();
+	r.setVertexAttribs(mesh, 0, (int)vertices.size(), vertices.data());
+	r.setVertexAttribs(mesh, 1, (int)colors.size(), colors.data());
+	r.setTriangleIndices(mesh, (int)triangles.size(), triangles.data());
+	R::Object points = r.createObject();
+	r.setVertexAttribs(points, 0, (int)vertices.size(), vertices.data());
+	r.setVertexAttribs(points, 1, (int)colors.size(), colors.data());
+	r.enableDepthTest();
+	r.useShaderProgram(program);
+
+	r.setUniform(program, "transform", rotate(mat4(1.0f), radians(10.0f), vec3(0.0f, 0.0f, 1.0f)));
+	const int nScenes = 2;
+	const char *scenes[nScenes] = {"mesh", "vertices only"};
+	const R::Object *objects[nScenes] = {&mesh, &points};
+	for (int s = 0; s < nScenes; s++) {
+		const R::Object &object = *objects[s];
+		std::vector<Bench::Mode> modes(2);
+		modes[0].name = "function pointers";
+		modes[0].frame = [&]() {
+			r.clear(vec4(0.0, 0.0, 0.0, 1.0));
+			r.drawObject(object);
+		};
+		modes[1].name = "templated";
+		modes[1].frame = [&]() {
+			r.clear(vec4(0.0, 0.0, 0.0, 1.0));
+			r.drawObject<R::VSColorTransform, R::FSIdentity>(object);
+		};
+		modes[0].frames = modes[1].frames = 10;
+		std::vector<Bench::Timing> timings = Bench::run(modes, 5);
+		for (size_t m = 0; m < modes.size(); m++)
+			std::cout << scenes[s] << ", " << modes[m].name << ": " << timings[m].ms << " ms/frame, speedup " << timings[0].ms/timings[m].ms << std::endl;
+
+		// both modes should render the same image
+		if (s == 0) {
+			std::vector<Uint8> images[2];
+			for (int m = 0; m < 2; m++) {
+				modes[m].frame();
+				images[m].resize((size_t)width*height*4);
+				r.readPixels(0, 0, width, height, images[m].data());
+			}
+			std::cout << "same image: " << (images[0] == images[1] ? "yes" : "no") << std::endl;
+		}
+	}
+	r.deleteShaderProgram(program);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include "bench.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+// Benchmark of setting uniforms, with the per-frame pattern of e6: for each of the clock's 63
+// quads (3 hands, 12 hour and 48 minute marks), set "transform" and "color", then draw.
+// The uniforms are set by name and by location without drawing, to time them alone, then with
+// the draws of a whole frame.
+namespace R = COL781::Software;
+using namespace glm;
+
+const int nQuads = 63;
+
+// Sets the uniforms of every quad of a frame by name, drawing each quad if shape is not NULL.
+void setByName(R::Rasterizer &r, R::ShaderProgram &program, const mat4 *transforms, const vec4 *colors, const R::Object *shape) {
+	r.useShaderProgram(program);
+	for (int k = 0; k < nQuads; k++) {
+		r.setUniform(program, "transform", transforms[k]);
+		r.setUniform(program, "color", colors[k]);
+		if (shape != NULL)
+			r.drawObject(*shape);
+	}
+}
+
+// The same, by location.
+void setByLocation(R::Rasterizer &r, R::ShaderProgram &program, int transform, int color, const mat4 *transforms, const vec4 *colors) {
+	r.useShaderProgram(program);
+	for (int k = 0; k < nQuads; k++) {
+		r.setUniform(program, transform, transforms[k]);
+		r.setUniform(program, color, colors[k]);
+	}
+}
+
+int main() {
+	R::Rasterizer r;
+	int width = 480, height = 480;
+	if (!Bench::initialize(r, width, height))
+		return EXIT_FAILURE;
+	R::ShaderProgram program = r.createShaderProgram(
+		r.vsColorTransform(),
+		r.fsConstant()
+	);
+	vec4 vertices[] = {
+		vec4(-0.5, -0.5, 0.0, 1.0),
+		vec4( 0.5, -0.5, 0.0, 1.0),
+		vec4(-0.5,  0.5, 0.0, 1.0),
+		vec4( 0.5,  0.5, 0.0, 1.0)
+	};
+	ivec3 triangles[] = {
+		ivec3(0, 1, 2),
+		ivec3(1, 2, 3)
+	};
+	R::Object shape = r.createObject();
+	r.setVertexAttribs(shape, 0, 4, vertices);
+	r.setTriangleIndices(shape, 2, triangles);
+	r.enableDepthTest();
+
+	// the hands at 10:10:30, then the marks around the dial
+	mat4 transforms[nQuads];
+	vec4 colors[nQuads];
+	const float handAngles[3] = {305.25f, 60.5f, 180.0f};
+	const vec3 handSizes[3] = {vec3(0.05f, 0.3f, 0.15f), vec3(0.03f, 0.4f, 0.2f), vec3(0.01f, 0.4f, 0.2f)};
+	for (int k = 0; k < 3; k++) {
+		mat4 hand = scale(mat4(1.0f), vec3(handSizes[k].x, handSizes[k].y, 1.0f));
+		mat4 view = translate(mat4(1.0f), vec3(0.0f, handSizes[k].z, -0.05f*k));
+		transforms[k] = rotate(mat4(1.0f), -radians(handAngles[k]), vec3(0.0f, 0.0f, 1.0f)) * view * hand;
+		colors[k] = k == 2 ? vec4(1.0, 0.0, 0.0, 1.0) : vec4(0.0, 0.0, 0.0, 1.0);
+	}
+	for (int i = 0; i < 60; i++) {
+		bool hour = i%5 == 0;
+		mat4 mark = scale(mat4(1.0f), hour ? vec3(0.05f, 0.1f, 1.0f) : vec3(0.02f, 0.05f, 1.0f));
+		mat4 view = translate(mat4(1.0f), vec3(0.0f, hour ? 0.45f : 0.475f, 0.0f));
+		transforms[3 + i] = rotate(mat4(1.0f), -radians(i*6.0f), vec3(0.0f, 0.0f, 1.0f)) * view * mark;
+		colors[3 + i] = vec4(0.0, 0.0, 0.0, 1.0);
+	}
+	int transform = r.getUniformLocation(program, "transform");
+	int color = r.getUniformLocation(program, "color");
+
+	std::vector<Bench::Mode> modes(3);
+	modes[0].name = "by name";
+	modes[0].frames = 20000;
+	modes[0].frame = [&]() { setByName(r, program, transforms, colors, NULL); };
+	modes[1].name = "by location";
+	modes[1].frames = 20000;
+	modes[1].frame = [&]() { setByLocation(r, program, transform, color, transforms, colors); };
+	modes[2].name = "by name, with draws";
+	modes[2].frames = 200;
+	modes[2].frame = [&]() {
+		r.clear(vec4(1.0, 1.0, 1.0, 1.0));
+		setByName(r, program, transforms, colors, &shape);
+		r.show();
+	};
+	std::vector<Bench::Timing> timings = Bench::run(modes, 5);
+	for (size_t m = 0; m < modes.size(); m++) {
+		std::cout << modes[m].name << ": " << timings[m].ms*1000 << " us/frame";
+		if (m < 2)
+			std::cout << ", " << timings[m].ms*1e6/(2*nQuads) << " ns/uniform";
+		if (timings[m].allocations >= 0)
+			std::cout << ", allocations/frame " << timings[m].allocations;
+		std::cout << std::endl;
+	}
+	r.deleteShaderProgram(program);
+	return EXIT_SUCCESS;
+}
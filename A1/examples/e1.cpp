@@ -1,12 +1,13 @@
 #include "../src/a1.hpp"
+#include "offscreen.hpp"
 
 namespace R = COL781::Software;
 // namespace R = COL781::Hardware;
 using namespace glm;
 
-int main() {
+int main(int argc, char **argv) {
 	R::Rasterizer r;
-    if (!r.initialize("Example 1", 640, 480))
+    if (!Offscreen::initialize(r, argc, argv, "Example 1", 640, 480))
         return EXIT_FAILURE;
     R::ShaderProgram program = r.createShaderProgram(
         r.vsIdentity(),
@@ -25,7 +26,7 @@ int main() {
 	R::Object tickmark = r.createObject();
 	r.setVertexAttribs(tickmark, 0, 4, vertices);
 	r.setTriangleIndices(tickmark, 2, triangles);
-    while (!r.shouldQuit()) {
+    while (!Offscreen::shouldQuit(r)) {
         r.clear(vec4(1.0, 1.0, 1.0, 1.0));
         r.useShaderProgram(program);
         r.setUniform<vec4>(program, "color", vec4(0.0, 0.6, 0.0, 1.0));
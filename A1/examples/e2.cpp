@@ -1,12 +1,13 @@
 #include "../src/a1.hpp"
+#include "offscreen.hpp"
 
 namespace R = COL781::Software;
 // namespace R = COL781::Hardware;
 using namespace glm;
 
-int main() {
+int main(int argc, char **argv) {
 	R::Rasterizer r;
-    if (!r.initialize("Example 2", 640, 480))
+    if (!Offscreen::initialize(r, argc, argv, "Example 2", 640, 480))
         return EXIT_FAILURE;
     R::ShaderProgram program = r.createShaderProgram(
         r.vsColor(),
@@ -32,7 +33,7 @@ int main() {
 	r.setVertexAttribs(shape, 0, 4, vertices);
 	r.setVertexAttribs(shape, 1, 4, colors);
 	r.setTriangleIndices(shape, 2, triangles);
-    while (!r.shouldQuit()) {
+    while (!Offscreen::shouldQuit(r)) {
         r.clear(vec4(1.0, 1.0, 1.0, 1.0));
         r.useShaderProgram(program);
 		r.drawObject(shape);
@@ -1,12 +1,13 @@
 #include "../src/a1.hpp"
+#include "offscreen.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 namespace R = COL781::Software;
 // namespace R = COL781::Hardware;
 using namespace glm;
 
-int main() {
+int main(int argc, char **argv) {
 	R::Rasterizer r;
-    if (!r.initialize("Example 1", 640, 480))
+    if (!Offscreen::initialize(r, argc, argv, "Example 1", 640, 480))
         return EXIT_FAILURE;
     R::ShaderProgram program = r.createShaderProgram(
         r.vsIdentity(),
@@ -42,7 +43,7 @@ int main() {
     // Enable depth test.
     r.enableDepthTest();
 
-    while (!r.shouldQuit()) {
+    while (!Offscreen::shouldQuit(r)) {
         r.clear(vec4(1.0, 1.0, 1.0, 1.0));
         r.useShaderProgram(program);
 
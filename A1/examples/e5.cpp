@@ -1,14 +1,15 @@
 #include "../src/a1.hpp"
+#include "offscreen.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 // Program with perspective correct interpolation of vertex attributes.
 
 namespace R = COL781::Software;
 // namespace R = COL781::Hardware;
 using namespace glm;
-int main() {
+int main(int argc, char **argv) {
 	R::Rasterizer r;
 	int width = 640, height = 480;
-    if (!r.initialize("Example 5", width, height))
+    if (!Offscreen::initialize(r, argc, argv, "Example 5", width, height))
         return EXIT_FAILURE;
 
     R::ShaderProgram program = r.createShaderProgram(
@@ -41,7 +42,7 @@ int main() {
 	mat4 view = translate(mat4(1.0f), vec3(0.0f, 0.0f, -2.0f)); 
     mat4 projection = perspective(radians(60.0f), (float)width/(float)height, 0.1f, 100.0f);
     float speed = 90.0f; // degrees per second
-    while (!r.shouldQuit()) {
+    while (!Offscreen::shouldQuit(r)) {
         float time = SDL_GetTicks64()*1e-3;
         r.clear(vec4(1.0, 1.0, 1.0, 1.0));
         r.useShaderProgram(program);
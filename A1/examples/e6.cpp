@@ -1,4 +1,5 @@
 #include "../src/a1.hpp"
+#include "offscreen.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <ctime>
 // Program with perspective correct interpolation of vertex attributes.
@@ -33,10 +34,10 @@ void createHourSymbol(int hour, R::Rasterizer &r, R::ShaderProgram &program, R::
 		r.drawObject(shape);
 }
 
-int main() {
+int main(int argc, char **argv) {
 	R::Rasterizer r;
 	int width = 480, height = 480;
-    if (!r.initialize("Example 6", width, height))
+    if (!Offscreen::initialize(r, argc, argv, "Example 6", width, height))
         return EXIT_FAILURE;
 
     R::ShaderProgram program = r.createShaderProgram(
@@ -59,7 +60,7 @@ int main() {
 	r.setTriangleIndices(shape, 2, triangles);
     r.enableDepthTest();
     
-    while (!r.shouldQuit()) {
+    while (!Offscreen::shouldQuit(r)) {
         std::time_t currentTime = std::time(nullptr);
 
         // Convert the current time to a local time structure
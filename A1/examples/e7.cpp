@@ -1,4 +1,5 @@
 #include "../src/a1.hpp"
+#include "offscreen.hpp"
 #include "../src/sw.cpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <ctime>
@@ -123,10 +124,10 @@ void createFlag(R::Rasterizer &r, R::ShaderProgram &program, R::Object &flagPole
         r.drawObject(Flag);
 }
 
-int main() {
+int main(int argc, char **argv) {
 	R::Rasterizer r;
 	int width = 480, height = 480;
-    if (!r.initialize("Example 7", width, height))
+    if (!Offscreen::initialize(r, argc, argv, "Example 7", width, height))
         return EXIT_FAILURE;
 
     R::ShaderProgram program = r.createShaderProgram(
@@ -288,7 +289,7 @@ int main() {
     
     mat4 projection = perspective(radians(60.0f), (float)width/(float)height, 0.1f, 100.0f);
 
-    while (!r.shouldQuit()) {
+    while (!Offscreen::shouldQuit(r)) {
         r.clear(vec4(0.0, 0.0, 1.0, 1.0));
         r.useShaderProgram(program);
         
@@ -0,0 +1,51 @@
+#ifndef OFFSCREEN_HPP
+#define OFFSCREEN_HPP
+
+#include "../src/a1.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Lets the examples run without a display (in a container, say). Running an example as
+//     eN --offscreen [frames] [prefix]
+// renders the given number of frames (1 by default) offscreen with the software rasterizer, and
+// saves each of them to prefix + a 5-digit frame number + ".ppm" (prefix is "frame" by default).
+// Without it, or with the hardware rasterizer, the example opens a window as usual.
+namespace Offscreen {
+
+	// Frames left to render offscreen, or -1 when rendering to a window.
+	inline int &framesLeft() {
+		static int frames = -1;
+		return frames;
+	}
+
+	// Initializes the rasterizer offscreen if the command line asks for it, or in a window.
+	inline bool initialize(COL781::Software::Rasterizer &r, int argc, char **argv, const std::string &title, int width, int height) {
+		if (argc < 2 || std::strcmp(argv[1], "--offscreen") != 0)
+			return r.initialize(title, width, height);
+		if (!r.initializeOffscreen(width, height))
+			return false;
+		framesLeft() = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 1;
+		r.startFrameSequence(argc > 3 ? argv[3] : "frame", COL781::Software::ImageFormat::PPM);
+		return true;
+	}
+
+	inline bool initialize(COL781::Hardware::Rasterizer &r, int argc, char **argv, const std::string &title, int width, int height) {
+		return r.initialize(title, width, height);
+	}
+
+	// Returns true when the example should stop: the user closed the window, or every offscreen
+	// frame has been rendered. To be called once per frame, in place of r.shouldQuit().
+	template <typename Rasterizer> bool shouldQuit(Rasterizer &r) {
+		if (framesLeft() < 0)
+			return r.shouldQuit();
+		if (framesLeft() == 0)
+			return true;
+		framesLeft()--;
+		return false;
+	}
+
+}
+
+#endif
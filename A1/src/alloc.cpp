@@ -0,0 +1,59 @@
+#include "alloc.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replacements for the global allocation functions that count every allocation, so that
+// the rasterizer can report how many happened during a frame. Memory still comes from malloc.
+// The nothrow and sized variants forward to these by default.
+// Only compiled in with A1_COUNT_ALLOCATIONS, as they apply to the whole program that links the library.
+
+#ifdef A1_COUNT_ALLOCATIONS
+
+namespace {
+	std::atomic<long long> allocations(0);
+}
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0)
+		size = 1;
+	while (true) {
+		void *p = std::malloc(size);
+		if (p)
+			return p;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+#endif
+
+namespace COL781 {
+	namespace Software {
+
+		long long allocationCount() {
+#ifdef A1_COUNT_ALLOCATIONS
+			return allocations.load(std::memory_order_relaxed);
+#else
+			return -1;
+#endif
+		}
+
+	}
+}
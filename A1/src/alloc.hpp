@@ -0,0 +1,15 @@
+#ifndef ALLOC_HPP
+#define ALLOC_HPP
+
+namespace COL781 {
+	namespace Software {
+
+		// Number of calls to the global operator new (and new[]) made so far by the whole program.
+		// Counted by alloc.cpp, which replaces the global allocation functions when the library is
+		// built with A1_COUNT_ALLOCATIONS. Returns -1 otherwise.
+		long long allocationCount();
+
+	}
+}
+
+#endif
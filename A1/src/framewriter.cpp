@@ -0,0 +1,185 @@
+#include "framewriter.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace COL781 {
+	namespace Software {
+
+		FrameWriter::FrameWriter(int n) : frames(n), head(0), queued(0), stopping(false) {
+			writer = std::thread(&FrameWriter::work, this);
+		}
+
+		FrameWriter::~FrameWriter() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			changed.notify_all();
+			writer.join();
+		}
+
+		FrameWriter::Frame &FrameWriter::acquire() {
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return queued < (int)frames.size(); });
+			return frames[(head + queued) % frames.size()];
+		}
+
+		void FrameWriter::submit() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queued++;
+			}
+			changed.notify_all();
+		}
+
+		void FrameWriter::flush() {
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return queued == 0; });
+		}
+
+		// Writes the queued frames in order, until stopped with none left.
+		void FrameWriter::work() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				changed.wait(lock, [this] { return queued > 0 || stopping; });
+				if (queued == 0)
+					return;
+				// the render thread does not touch a queued frame, so it can be written unlocked
+				Frame &frame = frames[head];
+				lock.unlock();
+				if (!writeImage(frame.path, frame.format, frame.width, frame.height, frame.rgba.data()))
+					printf("Could not write frame to %s\n", frame.path.c_str());
+				lock.lock();
+				head = (head + 1) % frames.size();
+				queued--;
+				changed.notify_all();
+			}
+		}
+
+		// Table of the CRC-32 of every byte value.
+		std::vector<unsigned long> crcTable() {
+			std::vector<unsigned long> table(256);
+			for (unsigned long k = 0; k < 256; k++) {
+				unsigned long c = k;
+				for (int b = 0; b < 8; b++)
+					c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+				table[k] = c;
+			}
+			return table;
+		}
+
+		// CRC-32 (as used by PNG) of n bytes, continuing from crc.
+		unsigned long crc32(unsigned long crc, const unsigned char *data, size_t n) {
+			static const std::vector<unsigned long> table = crcTable();
+			crc ^= 0xffffffffUL;
+			for (size_t i = 0; i < n; i++)
+				crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+			return crc ^ 0xffffffffUL;
+		}
+
+		// Appends a 32-bit big-endian integer.
+		void putBigEndian(std::vector<unsigned char> &out, unsigned long x) {
+			out.push_back((unsigned char)(x >> 24));
+			out.push_back((unsigned char)(x >> 16));
+			out.push_back((unsigned char)(x >> 8));
+			out.push_back((unsigned char)x);
+		}
+
+		// Writes a PNG chunk with the given 4-letter type.
+		bool writeChunk(FILE *file, const char *type, const std::vector<unsigned char> &data) {
+			std::vector<unsigned char> chunk;
+			putBigEndian(chunk, data.size());
+			chunk.insert(chunk.end(), type, type + 4);
+			chunk.insert(chunk.end(), data.begin(), data.end());
+			putBigEndian(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+			return fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+		}
+
+		// Writes an RGBA PNG whose image data is a zlib stream of uncompressed deflate blocks.
+		bool writePNG(FILE *file, int width, int height, const unsigned char *rgba) {
+			static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+			if (fwrite(signature, 1, 8, file) != 8)
+				return false;
+			std::vector<unsigned char> header;
+			putBigEndian(header, width);
+			putBigEndian(header, height);
+			const unsigned char format[5] = {8, 6, 0, 0, 0};   // 8 bits per channel, RGBA, no interlacing
+			header.insert(header.end(), format, format + 5);
+			if (!writeChunk(file, "IHDR", header))
+				return false;
+
+			// Every row starts with its filter type (0: none).
+			size_t rowBytes = (size_t)width*4;
+			std::vector<unsigned char> raw;
+			raw.reserve((rowBytes + 1)*height);
+			for (int j = 0; j < height; j++) {
+				raw.push_back(0);
+				raw.insert(raw.end(), rgba + rowBytes*j, rgba + rowBytes*(j + 1));
+			}
+			std::vector<unsigned char> zlib;
+			zlib.reserve(raw.size() + raw.size()/65535*5 + 16);
+			zlib.push_back(0x78);
+			zlib.push_back(0x01);
+			size_t pos = 0;
+			do {
+				size_t n = std::min(raw.size() - pos, (size_t)65535);
+				zlib.push_back(pos + n == raw.size() ? 1 : 0);   // final block?
+				zlib.push_back((unsigned char)n);
+				zlib.push_back((unsigned char)(n >> 8));
+				zlib.push_back((unsigned char)~n);
+				zlib.push_back((unsigned char)(~n >> 8));
+				zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + n);
+				pos += n;
+			} while (pos < raw.size());
+			// Adler-32 checksum of the uncompressed data
+			unsigned long a = 1, b = 0;
+			for (size_t i = 0; i < raw.size(); i++) {
+				a = (a + raw[i]) % 65521;
+				b = (b + a) % 65521;
+			}
+			putBigEndian(zlib, (b << 16) | a);
+			return writeChunk(file, "IDAT", zlib) && writeChunk(file, "IEND", std::vector<unsigned char>());
+		}
+
+		// Writes a binary PPM, dropping alpha.
+		bool writePPM(FILE *file, int width, int height, const unsigned char *rgba) {
+			if (fprintf(file, "P6\n%d %d\n255\n", width, height) < 0)
+				return false;
+			std::vector<unsigned char> row((size_t)width*3);
+			for (int j = 0; j < height; j++) {
+				const unsigned char *in = rgba + (size_t)width*4*j;
+				for (int i = 0; i < width; i++) {
+					row[3*i] = in[4*i];
+					row[3*i + 1] = in[4*i + 1];
+					row[3*i + 2] = in[4*i + 2];
+				}
+				if (fwrite(row.data(), 1, row.size(), file) != row.size())
+					return false;
+			}
+			return true;
+		}
+
+		bool writeImage(const std::string &path, ImageFormat format, int width, int height, const unsigned char *rgba) {
+			FILE *file = fopen(path.c_str(), "wb");
+			if (file == NULL)
+				return false;
+			bool ok = false;
+			switch (format) {
+				case ImageFormat::Raw: {
+					size_t bytes = (size_t)width*height*4;
+					ok = fwrite(rgba, 1, bytes, file) == bytes;
+					break;
+				}
+				case ImageFormat::PPM:
+					ok = writePPM(file, width, height, rgba);
+					break;
+				case ImageFormat::PNG:
+					ok = writePNG(file, width, height, rgba);
+					break;
+			}
+			return fclose(file) == 0 && ok;
+		}
+
+	}
+}
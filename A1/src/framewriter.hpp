@@ -0,0 +1,63 @@
+#ifndef FRAMEWRITER_HPP
+#define FRAMEWRITER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace COL781 {
+	namespace Software {
+
+		// File formats for saved frames:
+		// Raw: the RGBA bytes, row by row from the top, with no header.
+		// PPM: binary PPM (P6), dropping alpha.
+		// PNG: 8-bit RGBA PNG, stored without compression.
+		enum class ImageFormat { Raw, PPM, PNG };
+
+		class FrameWriter {
+			// Encodes and writes frames to files on a background thread, from a ring of frame buffers.
+			// acquire() and submit() must be called from a single thread.
+		public:
+			struct Frame {
+				std::string path;
+				ImageFormat format;
+				int width, height;
+				std::vector<unsigned char> rgba;   // width*height*4 bytes, row by row from the top
+			};
+
+			// Creates a writer with n frame buffers, which limits the number of frames in flight.
+			explicit FrameWriter(int n);
+			// Writes the frames still queued, then stops the background thread.
+			~FrameWriter();
+
+			// Returns the next frame buffer to fill, waiting for the background thread to free one if
+			// all of them are queued. Its contents are those of an earlier frame, so that the pixel
+			// storage can be reused.
+			Frame &acquire();
+			// Queues the frame returned by the last acquire() for writing.
+			void submit();
+			// Waits until every queued frame has been written.
+			void flush();
+
+		private:
+			void work();
+
+			std::vector<Frame> frames;
+			std::thread writer;
+			std::mutex mutex;
+			std::condition_variable changed;    // signalled when a frame is queued or written
+			int head;                           // the oldest queued frame
+			int queued;                         // frames queued and not yet written
+			bool stopping;
+		};
+
+		// Writes a width x height RGBA image to the file at path in the given format.
+		// Returns false if the file cannot be written.
+		bool writeImage(const std::string &path, ImageFormat format, int width, int height, const unsigned char *rgba);
+
+	}
+}
+
+#endif
@@ -203,6 +203,22 @@ namespace COL781 {
 			glCheckError();
 		}
 
+		void Rasterizer::enableFaceCulling(Face face) {
+			glEnable(GL_CULL_FACE);
+			glCullFace(face == Face::Front ? GL_FRONT : GL_BACK);
+			glCheckError();
+		}
+
+		void Rasterizer::disableFaceCulling() {
+			glDisable(GL_CULL_FACE);
+			glCheckError();
+		}
+
+		void Rasterizer::setFrontFace(Winding winding) {
+			glFrontFace(winding == Winding::CounterClockwise ? GL_CCW : GL_CW);
+			glCheckError();
+		}
+
 		void Rasterizer::clear(glm::vec4 color) {
 			glClearColor(color[0], color[1], color[2], color[3]);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -14,6 +14,12 @@ namespace COL781 {
 
 		using ShaderProgram = GLuint;
 
+		// A side of a triangle, as used by face culling.
+		enum class Face { Front, Back };
+
+		// The order in which a triangle's vertices appear on the screen.
+		enum class Winding { CounterClockwise, Clockwise };
+
 		struct Object {
 			GLuint vao;
 			int nTris;
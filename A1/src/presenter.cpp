@@ -0,0 +1,136 @@
+#include "presenter.hpp"
+
+#include <algorithm>
+
+namespace COL781 {
+	namespace Software {
+
+		bool renderable(const SDL_Surface *surface) {
+			const SDL_PixelFormat *format = surface->format;
+			if (format->BytesPerPixel != 4 || surface->pitch != surface->w*4 || SDL_MUSTLOCK(surface))
+				return false;
+			const Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+			const int shifts[4] = {format->Rshift, format->Gshift, format->Bshift, format->Ashift};
+			for (int c = 0; c < 4; c++)
+				if (masks[c] != 0 && (shifts[c] % 8 != 0 || masks[c] != (Uint32)0xff << shifts[c]))
+					return false;
+			// every colour channel must be stored
+			return masks[0] && masks[1] && masks[2];
+		}
+
+		Presenter::Presenter(SDL_Window *window, int width, int height, int n)
+			: window(window), direct(false), head(0), queued(0), stopping(false), totalLatency(0) {
+			// Render straight into the window surface if it is the right size and format, as
+			// presenting is then only updating the window. This cannot overlap rendering.
+			if (n == 1) {
+				SDL_Surface *windowSurface = SDL_GetWindowSurface(window);
+				if (windowSurface != NULL && windowSurface->w == width && windowSurface->h == height && renderable(windowSurface)) {
+					direct = true;
+					stats.direct = true;
+					surfaces.push_back(windowSurface);
+				}
+			}
+			for (int k = (int)surfaces.size(); k < n; k++) {
+				SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
+				if (surface == NULL)
+					break;
+				surfaces.push_back(surface);
+			}
+			starts.resize(surfaces.size());
+			if (surfaces.size() > 1)
+				presenter = std::thread(&Presenter::work, this);
+		}
+
+		Presenter::~Presenter() {
+			if (presenter.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				changed.notify_all();
+				presenter.join();
+			}
+			// the window surface belongs to the window
+			if (!direct)
+				for (size_t k = 0; k < surfaces.size(); k++)
+					SDL_FreeSurface(surfaces[k]);
+		}
+
+		int Presenter::size() const {
+			return (int)surfaces.size();
+		}
+
+		SDL_Surface *Presenter::acquire() {
+			if (surfaces.empty())
+				return NULL;
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return queued < (int)surfaces.size(); });
+			return surfaces[(head + queued) % surfaces.size()];
+		}
+
+		void Presenter::present(SDL_Surface *surface, Clock::time_point start) {
+			if (!presenter.joinable()) {
+				show(surface, start);
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				starts[(head + queued) % surfaces.size()] = start;
+				queued++;
+			}
+			changed.notify_all();
+		}
+
+		void Presenter::flush() {
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return queued == 0; });
+		}
+
+		PresentStats Presenter::getStats() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return stats;
+		}
+
+		// Presents the queued frames in order, until stopped with none left.
+		void Presenter::work() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				changed.wait(lock, [this] { return queued > 0 || stopping; });
+				if (queued == 0)
+					return;
+				// the render thread does not touch a queued framebuffer
+				SDL_Surface *surface = surfaces[head];
+				Clock::time_point start = starts[head];
+				lock.unlock();
+				show(surface, start);
+				lock.lock();
+				head = (head + 1) % surfaces.size();
+				queued--;
+				changed.notify_all();
+			}
+		}
+
+		// Copies the framebuffer to the window (unless it is the window surface), and records the frame's latency.
+		void Presenter::show(SDL_Surface *surface, Clock::time_point start) {
+			if (!direct) {
+				SDL_Surface *windowSurface = SDL_GetWindowSurface(window);
+				SDL_BlitScaled(surface, NULL, windowSurface, NULL);
+			}
+			SDL_UpdateWindowSurface(window);
+
+			Clock::time_point now = Clock::now();
+			double latency = std::chrono::duration<double, std::milli>(now - start).count();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stats.framesPresented == 0)
+				firstPresent = now;
+			lastPresent = now;
+			stats.framesPresented++;
+			totalLatency += latency;
+			stats.meanLatency = totalLatency/stats.framesPresented;
+			stats.maxLatency = std::max(stats.maxLatency, latency);
+			double elapsed = std::chrono::duration<double>(lastPresent - firstPresent).count();
+			stats.framesPerSecond = elapsed > 0 ? (stats.framesPresented - 1)/elapsed : 0;
+		}
+
+	}
+}
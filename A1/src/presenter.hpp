@@ -0,0 +1,78 @@
+#ifndef PRESENTER_HPP
+#define PRESENTER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <SDL2/SDL.h>
+#include <thread>
+#include <vector>
+
+namespace COL781 {
+	namespace Software {
+
+		struct PresentStats {
+			// Presentation counters, accumulated since the window's framebuffers were (re)created
+			long long framesPresented;
+			double framesPerSecond;   // over the time between the first and the last present
+			double meanLatency;       // in milliseconds, from the start of a frame to the window being updated
+			double maxLatency;
+			bool direct;              // frames are rendered straight into the window surface, with no blit
+			PresentStats() : framesPresented(0), framesPerSecond(0), meanLatency(0), maxLatency(0), direct(false) {}
+		};
+
+		// Returns true if the rasterizer can render into the surface: 32-bit pixels with byte-aligned
+		// 8-bit channels, rows of width pixels with no padding, and no need to lock it.
+		bool renderable(const SDL_Surface *surface);
+
+		class Presenter {
+			// Owns the framebuffers of a window, and presents them to it (blit, then window update).
+			// With one framebuffer, present() does so right away, and the framebuffer is the window
+			// surface itself when the rasterizer can render into it directly, so that no blit is needed.
+			// With more, frames are handed to a background thread, so that rendering the next frame
+			// overlaps presenting the previous ones.
+			// acquire() and present() must be called from a single thread.
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			// Creates n framebuffers of the given size for the window.
+			Presenter(SDL_Window *window, int width, int height, int n);
+			// Presents the frames still queued, then frees the framebuffers.
+			~Presenter();
+
+			// Number of framebuffers.
+			int size() const;
+
+			// Returns the framebuffer to render the next frame into, waiting for one to be presented
+			// if all the others are queued. Returns NULL if the framebuffers could not be created.
+			SDL_Surface *acquire();
+			// Presents the framebuffer returned by the last acquire(), whose frame started at start.
+			void present(SDL_Surface *surface, Clock::time_point start);
+			// Waits until every queued frame has been presented.
+			void flush();
+
+			PresentStats getStats() const;
+
+		private:
+			void work();
+			void show(SDL_Surface *surface, Clock::time_point start);
+
+			SDL_Window *window;
+			bool direct;                             // the only framebuffer is the window surface
+			std::vector<SDL_Surface*> surfaces;      // used in turn
+			std::vector<Clock::time_point> starts;   // start of the frame in each framebuffer
+			std::thread presenter;
+			mutable std::mutex mutex;
+			std::condition_variable changed;         // signalled when a frame is queued or presented
+			int head;                                // the oldest queued framebuffer
+			int queued;                              // framebuffers queued and not yet presented
+			bool stopping;
+			PresentStats stats;
+			double totalLatency;
+			Clock::time_point firstPresent, lastPresent;
+		};
+
+	}
+}
+
+#endif
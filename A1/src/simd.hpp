@@ -0,0 +1,192 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <algorithm>
+#include <SDL2/SDL.h>
+
+// The pixel kernels below process 4 horizontally adjacent pixels at a time.
+// They use SSE2 when it is available (always, on x86-64) unless A1_SCALAR is defined,
+// in which case a scalar version performing exactly the same sequence of IEEE float
+// operations is used instead, so that both produce bit-identical images.
+#if defined(__SSE2__) && !defined(A1_SCALAR)
+#define A1_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace COL781 {
+	namespace Software {
+		namespace Simd {
+
+			// Number of bits set in a 4-bit lane mask.
+			inline int count4(int mask) {
+				return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+			}
+
+			// Coverage of 4 consecutive pixel centres along a row, given the values e[k] of the three
+			// edge functions at the first one and their increments step[k] per pixel.
+			// Bit n of the result is set if e[k] + n*step[k] >= bias[k] for all three edges.
+			inline int coverage4(const long long e[3], const long long step[3], const long long bias[3]) {
+#ifdef A1_SIMD_SSE2
+				int outside = 0;
+				for (int k = 0; k < 3; k++) {
+					// lanes hold e + n*step - bias, whose sign bit is set iff the centre is outside
+					__m128i v01 = _mm_set_epi64x(e[k] + step[k] - bias[k], e[k] - bias[k]);
+					__m128i step2 = _mm_set1_epi64x(2*step[k]);
+					__m128i v23 = _mm_add_epi64(v01, step2);
+					outside |= _mm_movemask_pd(_mm_castsi128_pd(v01)) | (_mm_movemask_pd(_mm_castsi128_pd(v23)) << 2);
+				}
+				return ~outside & 0xf;
+#else
+				int mask = 0;
+				for (int n = 0; n < 4; n++)
+					if (e[0] + n*step[0] >= bias[0] && e[1] + n*step[1] >= bias[1] && e[2] + n*step[2] >= bias[2])
+						mask |= 1 << n;
+				return mask;
+#endif
+			}
+
+			// out[n] = (c + b*j) + a*(i + n): a plane equation evaluated at 4 consecutive pixels of row j.
+			inline void plane4(float a, float b, float c, int i, int j, float out[4]) {
+				float base = c + b*(float)j;
+#ifdef A1_SIMD_SSE2
+				__m128 x = _mm_add_ps(_mm_set1_ps((float)i), _mm_set_ps(3, 2, 1, 0));
+				_mm_storeu_ps(out, _mm_add_ps(_mm_set1_ps(base), _mm_mul_ps(_mm_set1_ps(a), x)));
+#else
+				for (int n = 0; n < 4; n++)
+					out[n] = base + a*((float)i + (float)n);
+#endif
+			}
+
+			// out[n] = 1/x[n]
+			inline void reciprocal4(const float x[4], float out[4]) {
+#ifdef A1_SIMD_SSE2
+				_mm_storeu_ps(out, _mm_div_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(x)));
+#else
+				for (int n = 0; n < 4; n++)
+					out[n] = 1.0f/x[n];
+#endif
+			}
+
+			// x[n] *= y[n]
+			inline void multiply4(float x[4], const float y[4]) {
+#ifdef A1_SIMD_SSE2
+				_mm_storeu_ps(x, _mm_mul_ps(_mm_loadu_ps(x), _mm_loadu_ps(y)));
+#else
+				for (int n = 0; n < 4; n++)
+					x[n] *= y[n];
+#endif
+			}
+
+			// Depth test: returns the lanes n of mask for which z[n] <= depth[n].
+			inline int depthTest4(const float z[4], const float depth[4], int mask) {
+#ifdef A1_SIMD_SSE2
+				return mask & _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(z), _mm_loadu_ps(depth)));
+#else
+				for (int n = 0; n < 4; n++)
+					if (!(z[n] <= depth[n]))
+						mask &= ~(1 << n);
+				return mask;
+#endif
+			}
+
+			// Depth test on integer depths: returns the lanes n of mask for which z[n] <= depth[n].
+			inline int depthTest4(const int z[4], const int depth[4], int mask) {
+#ifdef A1_SIMD_SSE2
+				__m128i greater = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)z), _mm_loadu_si128((const __m128i*)depth));
+				return mask & ~_mm_movemask_ps(_mm_castsi128_ps(greater));
+#else
+				for (int n = 0; n < 4; n++)
+					if (z[n] > depth[n])
+						mask &= ~(1 << n);
+				return mask;
+#endif
+			}
+
+			// Rounds x in [0, 2^24] to the nearest integer (ties to even), like _mm_cvtps_epi32 does.
+			inline float roundNearest(float x) {
+				// below 2^23, adding 2^23 leaves no fractional bits, so the FPU rounds for us;
+				// above, x is already an integer
+				const float shift = 8388608.0f;
+				return x < shift ? (x + shift) - shift : x;
+			}
+
+			// Converts 4 depths to an integer depth format: clamps them to [0, maxValue] and
+			// rounds them to the nearest integer (ties to even).
+			inline void quantize4(const float z[4], float maxValue, int out[4]) {
+#ifdef A1_SIMD_SSE2
+				__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(z), _mm_setzero_ps()), _mm_set1_ps(maxValue));
+				_mm_storeu_si128((__m128i*)out, _mm_cvtps_epi32(v));
+#else
+				for (int n = 0; n < 4; n++)
+					out[n] = (int)roundNearest(std::min(std::max(z[n], 0.0f), maxValue));
+#endif
+			}
+
+			// Sets the given number of bytes at out (a multiple of 4, and 4-byte aligned) to copies of a
+			// 32-bit pattern.
+			inline void fill32(void *out, size_t bytes, Uint32 pattern) {
+				Uint32 *p = (Uint32*)out;
+				size_t count = bytes/4, n = 0;
+#ifdef A1_SIMD_SSE2
+				// up to the first 16-byte boundary one by one, then 4 at a time
+				for (; n < count && (size_t)(p + n) % 16 != 0; n++)
+					p[n] = pattern;
+				__m128i v = _mm_set1_epi32((int)pattern);
+				for (; n + 4 <= count; n += 4)
+					_mm_store_si128((__m128i*)(p + n), v);
+#endif
+				for (; n < count; n++)
+					p[n] = pattern;
+			}
+
+			// Resolves the layout of a 32-bit pixel format with 8 bits per channel: for each of R, G, B and A,
+			// the shift of the channel and the mask of its bits (0 for a channel that is not stored).
+			inline void channelLayout(const SDL_PixelFormat *format, int shift[4], Uint32 mask[4]) {
+				shift[0] = format->Rshift; shift[1] = format->Gshift; shift[2] = format->Bshift; shift[3] = format->Ashift;
+				mask[0] = format->Rmask; mask[1] = format->Gmask; mask[2] = format->Bmask; mask[3] = format->Amask;
+			}
+
+			// Converts a colour component to an 8-bit unsigned normalized value: clamps it to [0, 1]
+			// (NaN gives 0), scales it to [0, 255] and truncates it, like a lane of pack4().
+			inline Uint32 unorm8(float x) {
+				x = x > 0.0f ? x : 0.0f;
+				x = x < 1.0f ? x : 1.0f;
+				return (Uint32)(int)(x*255.0f);
+			}
+
+			// Packs an RGBA colour into a pixel with the given channel layout (see channelLayout()).
+			inline Uint32 pack(const float color[4], const int shift[4], const Uint32 mask[4]) {
+				Uint32 p = 0;
+				for (int c = 0; c < 4; c++)
+					p |= (unorm8(color[c]) << shift[c]) & mask[c];
+				return p;
+			}
+
+			// Packs 4 RGBA colours into pixels with the given channel layout, as pack() does.
+			// Components are saturated to [0, 1], so that out-of-range colours clamp instead of wrapping.
+			inline void pack4(const float r[4], const float g[4], const float b[4], const float a[4],
+			                  const int shift[4], const Uint32 mask[4], Uint32 out[4]) {
+				const float *channel[4] = {r, g, b, a};
+#ifdef A1_SIMD_SSE2
+				__m128i p = _mm_setzero_si128();
+				for (int c = 0; c < 4; c++) {
+					// maxps returns its second operand for NaN, so NaN saturates to 0 as in unorm8()
+					__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(channel[c]), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+					__m128i u = _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+					u = _mm_sll_epi32(u, _mm_cvtsi32_si128(shift[c]));
+					p = _mm_or_si128(p, _mm_and_si128(u, _mm_set1_epi32((int)mask[c])));
+				}
+				_mm_storeu_si128((__m128i*)out, p);
+#else
+				for (int n = 0; n < 4; n++) {
+					float color[4] = {r[n], g[n], b[n], a[n]};
+					out[n] = pack(color, shift, mask);
+				}
+#endif
+			}
+
+		}
+	}
+}
+
+#endif
@@ -1,171 +1,233 @@
 #include "sw.hpp"
+#include "alloc.hpp"
+#include "simd.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
 namespace COL781 {
 	namespace Software {
 
-		// Forward declarations
-
-		template <> float Attribs::get(int index) const;
-		template <> glm::vec2 Attribs::get(int index) const;
-		template <> glm::vec3 Attribs::get(int index) const;
-		template <> glm::vec4 Attribs::get(int index) const;
-
-		template <> void Attribs::set(int index, float value);
-		template <> void Attribs::set(int index, glm::vec2 value);
-		template <> void Attribs::set(int index, glm::vec3 value);
-		template <> void Attribs::set(int index, glm::vec4 value);
-
 		// Built-in shaders
 
 		VertexShader Rasterizer::vsIdentity() {
 			return [](const Uniforms &uniforms, const Attribs &in, Attribs &out) {
-				glm::vec4 vertex = in.get<glm::vec4>(0);
-				// std::cout << "vs : " << vertex[0] << vertex[1] << vertex[2] << vertex[3] << "\n";
-				return vertex;
+				return VSIdentity()(uniforms, in, out);
 			};
 		}
 
 		VertexShader Rasterizer::vsTransform() {
 			return [](const Uniforms &uniforms, const Attribs &in, Attribs &out) {
-				glm::vec4 vertex = in.get<glm::vec4>(0);
-				glm::mat4 transform = uniforms.get<glm::mat4>("transform");
-				return transform * vertex;
+				return VSTransform()(uniforms, in, out);
 			};
 		}
 
 		VertexShader Rasterizer::vsColor() {
 			return [](const Uniforms &uniforms, const Attribs &in, Attribs &out) {
-				glm::vec4 vertex = in.get<glm::vec4>(0);
-				glm::vec4 color = in.get<glm::vec4>(1);
-				out.set<glm::vec4>(0, color);
-				return vertex;
+				return VSColor()(uniforms, in, out);
 			};
 		}
 
 		// this vs was to be implemented
 		VertexShader Rasterizer::vsColorTransform(){
 			return [](const Uniforms &uniforms, const Attribs &in, Attribs &out) {
-				glm::vec4 vertex = in.get<glm::vec4>(0);
-				glm::vec4 color = in.get<glm::vec4>(1);
-				out.set<glm::vec4>(0, color);
-				glm::mat4 transform = uniforms.get<glm::mat4>("transform");
-				return transform * vertex;
+				return VSColorTransform()(uniforms, in, out);
 			};
 		}
 
 		FragmentShader Rasterizer::fsConstant() {
 			return [](const Uniforms &uniforms, const Attribs &in) {
-				glm::vec4 color = uniforms.get<glm::vec4>("color");
-				return color;
+				return FSConstant()(uniforms, in);
 			};
 		}
 
 		FragmentShader Rasterizer::fsIdentity() {
 			return [](const Uniforms &uniforms, const Attribs &in) {
-				glm::vec4 color = in.get<glm::vec4>(0);
-				return color;
+				return FSIdentity()(uniforms, in);
 			};
 		}
 
-		// Implementation of Attribs and Uniforms classes
+		// Implementation of Uniforms class (Attribs and the accessors by location are in sw.hpp)
 
-		void checkDimension(int index, int actual, int requested) {
-			if (actual != requested) {
-				// std::cout << "Warning: attribute " << index << " has dimension " << actual << " but accessed as dimension " << requested << std::endl;
-			}
-		}
+		const int Uniforms::TRANSFORM;
+		const int Uniforms::COLOR;
 
-		template <> float Attribs::get(int index) const {
-			checkDimension(index, dims[index], 1);
-			return values[index].x;
+		Uniforms::Uniforms() {
+			create("transform", glm::mat4(1));
+			create("color", glm::vec4(0, 0, 0, 1));
 		}
 
-		template <> glm::vec2 Attribs::get(int index) const {
-			checkDimension(index, dims[index], 2);
-			return glm::vec2(values[index].x, values[index].y);
+		int Uniforms::getLocation(const std::string &name) const {
+			auto it = locations.find(name);
+			return it != locations.end() ? it->second : -1;
 		}
 
-		template <> glm::vec3 Attribs::get(int index) const {
-			checkDimension(index, dims[index], 3);
-			return glm::vec3(values[index].x, values[index].y, values[index].z);
+		template <typename T> T Uniforms::get(const std::string &name) const {
+			return get<T>(locations.at(name));
 		}
 
-		template <> glm::vec4 Attribs::get(int index) const {
-			checkDimension(index, dims[index], 4);
-			return values[index];
+		template <typename T> void Uniforms::set(const std::string &name, T value) {
+			auto it = locations.find(name);
+			if (it != locations.end() && it->second%TYPES == type<T>())
+				set(it->second, value);
+			else
+				create(name, value);
 		}
 
-		void expand(std::vector<int> &dims, std::vector<glm::vec4> &values, int index) {
-			if (dims.size() < index+1)
-				dims.resize(index+1);
-			if (values.size() < index+1)
-				values.resize(index+1);
+		// Adds a uniform at the end of the array of its type, and returns its location.
+		template <typename T> int Uniforms::create(const std::string &name, T value) {
+			std::vector<T> &array = values<T>();
+			int location = (int)array.size()*TYPES + type<T>();
+			array.push_back(value);
+			locations[name] = location;
+			return location;
 		}
 
-		template <> void Attribs::set(int index, float value) {
-			expand(dims, values, index);
-			dims[index] = 1;
-			values[index].x = value;
-		}
 
-		template <> void Attribs::set(int index, glm::vec2 value) {
-			expand(dims, values, index);
-			dims[index] = 2;
-			values[index].x = value.x;
-			values[index].y = value.y;
-		}
 
-		template <> void Attribs::set(int index, glm::vec3 value) {
-			expand(dims, values, index);
-			dims[index] = 3;
-			values[index].x = value.x;
-			values[index].y = value.y;
-			values[index].z = value.z;
+		// Built-in sample patterns: sample offsets from the pixel centre, in 1/32 pixel (x right, y down).
+		// Samples are at the pixel centre with 1 sample per pixel, whatever the pattern.
+		const int CENTRE_1[1][2] = {{0, 0}};
+		// The standard positions used by Direct3D and most GPUs. Unlike the other patterns, the 16-sample
+		// table is not strictly inside the pixel: {-16, 0} and {-14, -16} lie on its left and top edges.
+		// No sample is at +16, so no point is a sample of two neighbouring pixels, and coverage is
+		// not counted twice.
+		const int STANDARD_2[2][2] = {{8, 8}, {-8, -8}};
+		const int STANDARD_4[4][2] = {{-4, -12}, {12, -4}, {-12, 4}, {4, 12}};
+		const int STANDARD_8[8][2] = {{2, -6}, {-2, 6}, {10, 2}, {-6, -10}, {-10, 10}, {-14, -2}, {6, 14}, {14, -14}};
+		const int STANDARD_16[16][2] = {{2, 2}, {-2, -6}, {-6, 4}, {8, -2}, {-10, -4}, {4, 10}, {10, 6}, {6, -10},
+		                                {-4, 12}, {0, -14}, {-8, -12}, {-12, 8}, {-16, 0}, {14, -8}, {12, 14}, {-14, -16}};
+		// Regular m x m grids, with the samples at the centres of the cells.
+		const int ORDERED_4[4][2] = {{-8, -8}, {8, -8}, {-8, 8}, {8, 8}};
+		const int ORDERED_16[16][2] = {{-12, -12}, {-4, -12}, {4, -12}, {12, -12}, {-12, -4}, {-4, -4}, {4, -4}, {12, -4},
+		                               {-12, 4}, {-4, 4}, {4, 4}, {12, 4}, {-12, 12}, {-4, 12}, {4, 12}, {12, 12}};
+		// m x m grids rotated so that, on an n x n subgrid, no two samples share a row or a column.
+		const int ROTATED_4[4][2] = {{4, -12}, {-12, -4}, {12, 4}, {-4, 12}};
+		const int ROTATED_16[16][2] = {{9, -15}, {1, -13}, {-7, -11}, {-15, -9}, {11, -7}, {3, -5}, {-5, -3}, {-13, -1},
+		                               {13, 1}, {5, 3}, {-3, 5}, {-11, 7}, {15, 9}, {7, 11}, {-1, 13}, {-9, 15}};
+		// n-queens arrangements on an n x n subgrid: no two samples share a row, a column or a diagonal.
+		const int SPARSE_8[8][2] = {{-14, -14}, {2, -10}, {14, -6}, {6, -2}, {-6, 2}, {10, 6}, {-10, 10}, {-2, 14}};
+		const int SPARSE_16[16][2] = {{-15, -15}, {-9, -13}, {-3, -11}, {3, -9}, {9, -7}, {15, -5}, {-5, -3}, {-11, -1},
+		                              {7, 1}, {13, 3}, {1, 5}, {-7, 7}, {11, 9}, {-13, 11}, {5, 13}, {-1, 15}};
+
+		// Returns the offsets of the given pattern with spp samples per pixel, or NULL if it has no such variant.
+		const int (*samplePattern(SamplePattern pattern, int spp))[2] {
+			if (spp == 1)
+				return CENTRE_1;
+			switch (pattern) {
+				case SamplePattern::Standard:
+					return spp == 2 ? STANDARD_2 : spp == 4 ? STANDARD_4 : spp == 8 ? STANDARD_8 : spp == 16 ? STANDARD_16 : NULL;
+				case SamplePattern::OrderedGrid:
+					return spp == 4 ? ORDERED_4 : spp == 16 ? ORDERED_16 : NULL;
+				case SamplePattern::RotatedGrid:
+					return spp == 4 ? ROTATED_4 : spp == 16 ? ROTATED_16 : NULL;
+				case SamplePattern::Sparse:
+					// the 4-queens arrangement is the rotated grid
+					return spp == 4 ? ROTATED_4 : spp == 8 ? SPARSE_8 : spp == 16 ? SPARSE_16 : NULL;
+			}
+			return NULL;
 		}
 
-		template <> void Attribs::set(int index, glm::vec4 value) {
-			expand(dims, values, index);
-			dims[index] = 4;
-			values[index] = value;
+		Rasterizer::Rasterizer() : window(NULL), framebuffer(NULL), activeProgram(NULL), supersampling_n(1), sequenceActive(false) {}
+
+		Rasterizer::~Rasterizer() {
+			// a window's framebuffers belong to its presenter
+			if (!presenter)
+				SDL_FreeSurface(framebuffer);
 		}
 
-		template <typename T> T Uniforms::get(const std::string &name) const {
-			return *(T*)values.at(name);
+		// Creates a window with the given title, size, and samples per pixel (1, 2, 4, 8 or 16).
+		bool Rasterizer::initialize(const std::string &title, int width, int height, int spp){
+			return initialize(title, width, height, spp, SamplePattern::Standard);
 		}
 
-		template <typename T> void Uniforms::set(const std::string &name, T value) {
-			auto it = values.find(name);
-			if (it != values.end()) {
-				delete it->second;
+		// Creates a window with the given title, size, and samples per pixel, placed in the given pattern.
+		bool Rasterizer::initialize(const std::string &title, int width, int height, int spp, SamplePattern pattern){
+			window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_SHOWN);
+			if (window == NULL) {
+				printf("Window could not be created! SDL_Error: %s", SDL_GetError());
+				return false;
 			}
-			values[name] = (void*)(new T(value));
+			return initializeTarget(width, height, spp, pattern);
 		}
 
+		// Initializes the rasterizer without a window, to render offscreen into an RGBA framebuffer.
+		bool Rasterizer::initializeOffscreen(int width, int height, int spp, SamplePattern pattern){
+			window = NULL;
+			return initializeTarget(width, height, spp, pattern);
+		}
 
-		// Creates a window with the given title, size, and samples per pixel.
-		bool Rasterizer::initialize(const std::string &title, int width, int height, int spp){
+		// Sets up the framebuffer and rendering state for a width x height viewport, once the
+		// window (if any) has been created.
+		bool Rasterizer::initializeTarget(int width, int height, int spp, SamplePattern pattern){
 			int screenWidth = width;
 			int screenHeight = height;
-			supersampling_n = spp;
-			window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screenWidth, screenHeight, SDL_WINDOW_SHOWN);
-			if (window == NULL) {
-				printf("Window could not be created! SDL_Error: %s", SDL_GetError());
+			const int (*samples)[2] = samplePattern(pattern, spp);
+			if (samples == NULL) {
+				printf("Unsupported number of samples per pixel for this sample pattern: %d\n", spp);
 				return false;
 			}
+			// Precompute the offsets on the fixed-point sub-pixel grid, from which the rasterizer
+			// derives the per-sample steps of each triangle's edge functions.
+			supersampling_n = spp;
+			sampleOffsets.resize(spp);
+			samplePositions.resize(spp);
+			for (int s = 0; s < spp; s++) {
+				int dx = samples[s][0]*SUBPIXEL_ONE/32, dy = samples[s][1]*SUBPIXEL_ONE/32;
+				sampleOffsets[s] = glm::ivec2(dx, dy);
+				samplePositions[s] = glm::vec2((float)dx/SUBPIXEL_ONE, (float)dy/SUBPIXEL_ONE);
+				if (s == 0)
+					sampleMin = sampleMax = sampleOffsets[s];
+				sampleMin = glm::ivec2(std::min(sampleMin.x, dx), std::min(sampleMin.y, dy));
+				sampleMax = glm::ivec2(std::max(sampleMax.x, dx), std::max(sampleMax.y, dy));
+			}
 			quit = false;
+			resizeFramebuffer(screenWidth, screenHeight);
+			if (framebuffer == NULL) {
+				printf("Framebuffer could not be created! SDL_Error: %s", SDL_GetError());
+				return false;
+			}
 			zbuffering = false;
+			depthFormat = DepthFormat::D32F;
+			resizeDepthBuffer(screenWidth, screenHeight);
+			faceCulling = false;
+			culledFace = Face::Back;
+			frontFace = Winding::CounterClockwise;
+			frameAllocations = allocationCount();
+			if (!pool)
+				setThreadCount(std::thread::hardware_concurrency());
 			return true;
 		}
 		
 		// Creates a new shader program, i.e. a pair of a vertex shader and a fragment shader.
 		ShaderProgram Rasterizer::createShaderProgram(const VertexShader &vs, const FragmentShader &fs){
-			ShaderProgram new_shader_prog;
-			new_shader_prog.vs = vs;
-			new_shader_prog.fs = fs;
-			return new_shader_prog;
+			std::unique_ptr<Program> program(new Program());
+			program->vs = vs;
+			program->fs = fs;
+			ShaderProgram handle;
+			handle.id = (int)programs.size();
+			programs.push_back(std::move(program));
+			return handle;
+		}
+
+		// Returns the program with the given handle, or NULL if it is invalid or deleted.
+		Program *Rasterizer::getProgram(const ShaderProgram &program) const {
+			if (program.id < 0 || program.id >= (int)programs.size())
+				return NULL;
+			return programs[program.id].get();
+		}
+
+		// Makes the program active, if it exists, and returns it.
+		Program *Rasterizer::bindProgram(const ShaderProgram &program) {
+			Program *p = getProgram(program);
+			if (p != NULL)
+				activeProgram = p;
+			return p;
 		}
 
 		// Creates an object, i.e. a collection of vertices and triangles.
@@ -246,272 +308,851 @@ namespace COL781 {
 			return quit;
 		}
 
+		// Enable culling of the triangles whose given face (front or back) is towards the viewer.
+		void Rasterizer::enableFaceCulling(Face face) {
+			faceCulling = true;
+			culledFace = face;
+		}
+
+		// Disable face culling.
+		void Rasterizer::disableFaceCulling() {
+			faceCulling = false;
+		}
+
+		// Sets the winding of the projected vertices that makes a triangle front-facing.
+		void Rasterizer::setFrontFace(Winding winding) {
+			frontFace = winding;
+		}
+
 		// Clear the framebuffer, setting all pixels to the given color.
 		void Rasterizer::clear(glm::vec4 color){
-			int width, height;
-    		SDL_GetWindowSize(window, &width, &height);
-			// std::cout << width << " " << height << " \n";
-			SDL_Surface* windowSurface = SDL_GetWindowSurface(window);
-            framebuffer = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
-			// std::cout << windowSurface << " " << framebuffer << "\n";
-			Uint32 *pixels = (Uint32*)framebuffer->pixels;
-            SDL_PixelFormat *format = framebuffer->format;
-            for (int i = 0; i < width; i++) {
-                for (int j = 0; j < height; j++) {
-                    Uint32 colorij = SDL_MapRGBA(format, 255*color.r, 255*color.g, 255*color.b, 255*color.a);
-                    pixels[i + width*j] = colorij;
-                }
-            }
+			int width = framebuffer->w, height = framebuffer->h;
+			if (window != NULL)
+				SDL_GetWindowSize(window, &width, &height);
+			if (width != framebuffer->w || height != framebuffer->h)
+				resizeFramebuffer(width, height);
+			// The tiles are filled lazily (see fillTile()); those already holding the colour are left alone.
+			float rgba[4] = {color.r, color.g, color.b, color.a};
+			Uint32 packed = Simd::pack(rgba, channelShift, channelMask);
+			for (size_t t = 0; t < tileStates.size(); t++)
+				if (tileStates[t] != TILE_CLEAR || packed != clearColor)
+					tileStates[t] = TILE_PENDING;
+			clearColor = packed;
+			frameStart = Presenter::Clock::now();
 
 			// clear the z buffer as well
-			if (zbuffering){
-				for (int i=1; i<width; i++){
-					for (int j=0; j<height; j++){
-						zbuffer[i][j]=FLT_MAX;				
-					}
-				}
-			}
+			if (width != zwidth || height != zheight)
+				resizeDepthBuffer(width, height);
+			else if (zbuffering)
+				clearDepthBuffer();
 			// SDL_BlitScaled(framebuffer, NULL, windowSurface, NULL);
             // SDL_UpdateWindowSurface(window);
+
+			// a new frame starts: reset the work counters
+			stats = Stats();
+			frameAllocations = allocationCount();
 		}
 
 		// Makes the given shader program active. Future draw calls will use its vertex and fragment shaders.
 		void Rasterizer::useShaderProgram(const ShaderProgram &program){
-			rasterizerProgram = program;
-			return;
+			bindProgram(program);
 		}
 
+		// Uniforms are written into the program itself, which also becomes active.
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, glm::vec2 value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, glm::vec3 value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, glm::vec4 value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, glm::mat2 value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, glm::mat3 value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, glm::mat4 value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, float value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
 		}
 		template <> void Rasterizer::setUniform(ShaderProgram &program, const std::string &name, int value){
-			program.uniforms.set(name, value);
-			rasterizerProgram = program;
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(name, value);
+		}
+
+		int Rasterizer::getUniformLocation(const ShaderProgram &program, const std::string &name) {
+			Program *p = getProgram(program);
+			return p != NULL ? p->uniforms.getLocation(name) : -1;
+		}
+
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, float value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, int value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, glm::vec2 value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, glm::vec3 value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, glm::vec4 value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, glm::mat2 value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, glm::mat3 value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
+		}
+		template <> void Rasterizer::setUniform(ShaderProgram &program, int location, glm::mat4 value) {
+			if (Program *p = bindProgram(program))
+				p->uniforms.set(location, value);
 		}
 
 		// template <typename T> void setUniform(ShaderProgram &program, const std::string &name, T value){
 		// 	program.uniforms.set(name, value);
-		// 	rasterizerProgram = program;
 		// }
 
 
-		// 
-		void Rasterizer::drawObject(const Object &object){
-			int width, height;
-    		SDL_GetWindowSize(window, &width, &height);
-			SDL_Surface* windowSurface = SDL_GetWindowSurface(window);
-			// SDL_Surface* framebuffer = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
-				Uint32 *pixels = (Uint32*)framebuffer->pixels;
-				SDL_PixelFormat *format = framebuffer->format;
-			for (auto triangle : object.indices){
-				
-				int v1_index, v2_index, v3_index;
-				v1_index = triangle.x;
-				v2_index = triangle.y;
-				v3_index = triangle.z;
-				// std::cout<<v1_index<<v2_index<<v3_index<<"\n";
-				Attribs v1, v2, v3;
-				for (int i = 0; i<object.attributeDims.size(); i++){
-					int dim = object.attributeDims[i];
-					std::vector<float> val = object.attributeValues[i];
-					switch (dim) {
-						case 1:
-							v1.set(i, val[v1_index]);
-							v2.set(i, val[v1_index]);
-							v3.set(i, val[v1_index]);
-						case 2:	
-							v1.set(i, glm::vec2(val[2*v1_index], val[2*v1_index+1]));
-							v2.set(i, glm::vec2(val[2*v2_index], val[2*v2_index+1]));
-							v3.set(i, glm::vec2(val[2*v3_index], val[2*v3_index+1]));
-						case 3:
-							v1.set(i, glm::vec3(val[3*v1_index], val[3*v1_index+1], val[3*v1_index+2]));
-							v2.set(i, glm::vec3(val[3*v2_index], val[3*v2_index+1], val[3*v2_index+2]));
-							v3.set(i, glm::vec3(val[3*v3_index], val[3*v3_index+1], val[3*v3_index+2]));
-						case 4:
-							// std::cout << "case4\n";
-							// std::cout << val[4*v1_index] << val[4*v1_index+1] << val[4*v1_index+2] << val[4*v1_index+3] << "\n";
-							v1.set(i, glm::vec4(val[4*v1_index], val[4*v1_index+1], val[4*v1_index+2], val[4*v1_index+3]));
-							v2.set(i, glm::vec4(val[4*v2_index], val[4*v2_index+1], val[4*v2_index+2], val[4*v2_index+3]));
-							v3.set(i, glm::vec4(val[4*v3_index], val[4*v3_index+1], val[4*v3_index+2], val[4*v3_index+3]));
-					}					
-				} 
-				Attribs v1_out, v2_out, v3_out;
-				v1_out = v1; v2_out = v2; v3_out = v3;
-				glm::vec4 v1_ndc, v2_ndc, v3_ndc;
-				// std::cout << v1_ndc[0]  << v1_ndc[1] << v2_ndc[0] << "\n";
-				v1_ndc = rasterizerProgram.vs(rasterizerProgram.uniforms, v1, v1_out);
-				v2_ndc = rasterizerProgram.vs(rasterizerProgram.uniforms, v2, v2_out);
-				v3_ndc = rasterizerProgram.vs(rasterizerProgram.uniforms, v3, v3_out);
-
-
-				// To support 3D tringles, we include the perspective division stage after the vertex shader
-				// v1_out = glm::vec4(v1_ndc[0]/v1_ndc[3], )
-				float w1,w2,w3; w1=v1_ndc[3]; w1=v2_ndc[3]; w1=v3_ndc[3];
-				// std::cout << w1 << " " << w2 << " " << w3 << "\n";
-				float z_1,z_2,z_3; z_1 = v1_ndc[2]+0.000001; z_2=v2_ndc[2]+0.000001; z_3=v3_ndc[2]+0.000001;
-				v1_ndc = glm::vec4(v1_ndc[0]/v1_ndc[3], v1_ndc[1]/v1_ndc[3], v1_ndc[2]/v1_ndc[3], 1.0);
-				v2_ndc = glm::vec4(v2_ndc[0]/v2_ndc[3], v2_ndc[1]/v2_ndc[3], v2_ndc[2]/v2_ndc[3], 1.0);
-				v3_ndc = glm::vec4(v3_ndc[0]/v3_ndc[3], v3_ndc[1]/v3_ndc[3], v3_ndc[2]/v3_ndc[3], 1.0);
-
-				// for z buffering
-				float z1, z2, z3;
-				z1 = v1_ndc[2];
-				z2 = v2_ndc[2];
-				z3 = v3_ndc[2];
-
-				// std::cout<<"here1\n";
-				glm::vec4 v1_col, v2_col, v3_col;
-				v1_col = rasterizerProgram.fs(rasterizerProgram.uniforms, v1_out);
-				v2_col = rasterizerProgram.fs(rasterizerProgram.uniforms, v2_out);
-				v3_col = rasterizerProgram.fs(rasterizerProgram.uniforms, v3_out);
-
-				float x1,y1,x2,y2,x3,y3;
-				x1 = v1_ndc[0];
-				y1 = v1_ndc[1];
-				x2 = v2_ndc[0];
-				y2 = v2_ndc[1];
-				x3 = v3_ndc[0];
-				y3 = v3_ndc[1];
-				// std::cout << x1 << " " << y1 << " " << x1/v1_ndc[2] << " " << x2/v2_ndc[2] << "\n";
-
-				// std::cout << v1_ndc[0] <<" "<<v1_ndc[1]<<" " <<v2_ndc[0]<<" "<<v1_ndc[1]<<" "<<x3<<" "<<y3<<"\n";
-				float c_left_or_right = (-(y2-y1)*(x3-x1)+(x2-x1)*(y3-y1));
-				for (int i = 0; i < width; i++) {
-					for (int j = 0; j < height; j++) {
-						// glm::vec4 = glm::cross(v1_ndc-v2_ndc,v3_ndc-v2_ndc);
-						// float total = 0;
-						// if zbuffer[i][j]
-
-
-						float x = (i + 0.5 )/width;
-						float y = (j + 0.5  )/height;
-						x = 2*x-1;
-						y = 1 - 2*y;
-						float bary_1 = 0.;
-						float bary_2 = 0.;
-						float bary_3 = 0.;
-						if ((c_left_or_right>=0 && (-(y2-y1)*(x-x1)+(x2-x1)*(y-y1)>=0 && -(y3-y2)*(x-x2)+(x3-x2)*(y-y2)>=0 && -(y1-y3)*(x-x3)+(x1-x3)*(y-y3)>=0)) || (c_left_or_right<0 && (-(y2-y1)*(x-x1)+(x2-x1)*(y-y1)<=0 && -(y3-y2)*(x-x2)+(x3-x2)*(y-y2)<=0 && -(y1-y3)*(x-x3)+(x1-x3)*(y-y3)<=0)))
-						{
-							for (int k=0; k<sqrt(supersampling_n); k++){
-								for (int l=0; l<sqrt(supersampling_n); l++) {
-									float xi = (i + 0.5 + (float)k/(float)sqrt(supersampling_n))/width;
-									float yi = (j + 0.5 + (float)l/(float)sqrt(supersampling_n))/height;
-									xi = 2*xi-1;
-									yi = 1 - 2*yi;
-									if ((c_left_or_right>=0 && (-(y2-y1)*(xi-x1)+(x2-x1)*(yi-y1)>=0 && -(y3-y2)*(xi-x2)+(x3-x2)*(yi-y2)>=0 && -(y1-y3)*(xi-x3)+(x1-x3)*(yi-y3)>=0)) || 
-									(c_left_or_right<0 && (-(y2-y1)*(xi-x1)+(x2-x1)*(yi-y1)<=0 && -(y3-y2)*(xi-x2)+(x3-x2)*(yi-y2)<=0 && -(y1-y3)*(xi-x3)+(x1-x3)*(yi-y3)<=0))){
-									// std::cout << "X Y " << xi << " " << yi << "\n";
-									// float total = glm::length(glm::cross(glm::vec3(v1_ndc[0]/v1_ndc[2]-v2_ndc[0]/v2_ndc[2], v1_ndc[1]/v1_ndc[2]-v2_ndc[1]/v2_ndc[2],0), glm::vec3(v3_ndc[0]/v3_ndc[2]-v2_ndc[0]/v2_ndc[2], v3_ndc[1]/v3_ndc[2]-v2_ndc[1]/v2_ndc[2],0)));
-									float total = glm::length(glm::cross(glm::vec3(v1_ndc[0]-v2_ndc[0], v1_ndc[1]-v2_ndc[1],0), glm::vec3(v3_ndc[0]-v2_ndc[0], v3_ndc[1]-v2_ndc[1],0)));
-									bary_1 += glm::length(glm::cross(glm::vec3(v2_ndc[0]-xi, v2_ndc[1]-yi,0), glm::vec3(v3_ndc[0]-xi, v3_ndc[1]-yi,0)))/total;
-									bary_2 += glm::length(glm::cross(glm::vec3(v3_ndc[0]-xi, v3_ndc[1]-yi,0), glm::vec3(v1_ndc[0]-xi, v1_ndc[1]-yi,0)))/total;
-									bary_3 += glm::length(glm::cross(glm::vec3(v1_ndc[0]-xi, v1_ndc[1]-yi,0), glm::vec3(v2_ndc[0]-xi, v2_ndc[1]-yi,0)))/total;
-									// bary_1 += glm::length(glm::cross(glm::vec3(v2_ndc[0]/v2_ndc[2]-xi, v2_ndc[1]/v2_ndc[2]-yi,0), glm::vec3(v3_ndc[0]/v3_ndc[2]-xi, v3_ndc[1]/v3_ndc[2]-yi,0)))/total;
-									// bary_2 += glm::length(glm::cross(glm::vec3(v3_ndc[0]/v3_ndc[2]-xi, v3_ndc[1]/v3_ndc[2]-yi,0), glm::vec3(v1_ndc[0]/v1_ndc[2]-xi, v1_ndc[1]/v1_ndc[2]-yi,0)))/total;
-									// bary_3 += glm::length(glm::cross(glm::vec3(v1_ndc[0]/v1_ndc[2]-xi, v1_ndc[1]/v1_ndc[2]-yi,0), glm::vec3(v2_ndc[0]/v2_ndc[2]-xi, v2_ndc[1]/v2_ndc[2]-yi,0)))/total;
-								// float total = glm::length(glm::cross(glm::vec3(v1_ndc[0]-v2_ndc[0], v1_ndc[1]-v2_ndc[1],0), glm::vec3(v3_ndc[0]-v2_ndc[0], v3_ndc[1]-v2_ndc[1],0)));
-								// bary_1 = bary_1 + glm::length(glm::cross(glm::vec3(v2_ndc[0]-x, v2_ndc[1]-y,0), glm::vec3(v3_ndc[0]-x, v3_ndc[1]-y,0)))/total;
-								// bary_2 = bary_2 + glm::length(glm::cross(glm::vec3(v3_ndc[0]-x, v3_ndc[1]-y,0), glm::vec3(v1_ndc[0]-x, v1_ndc[1]-y,0)))/total;
-								// bary_3 = bary_3 + glm::length(glm::cross(glm::vec3(v1_ndc[0]-x, v1_ndc[1]-y,0), glm::vec3(v2_ndc[0]-x, v2_ndc[1]-y,0)))/total;
-									}
-								}
-							}
-							bary_1 = bary_1/(float)supersampling_n;
-							bary_2 = bary_2/(float)supersampling_n;
-							bary_3 = bary_3/(float)supersampling_n;
-							if (bary_1==0.0 || bary_2==0.0 || bary_3==0.0){bary_1=1.0; bary_2=0.0; bary_3=0.0;}
-							// std::cout << "Barry : " << bary_1 << " " << bary_2 << " "<< bary_3 << "\n";
-							// float z_curr = 10000/(bary_1/z_1 + bary_2/z_2 + bary_3/z_3);
-							float z_curr = (bary_1*z1 + bary_2*z2 + bary_3*z3);
-							// std::cout << "z value " << z_1 << " " << z_2 << " " << z_3 << "\n";
-							if (zbuffering){
-								// std::cout << "zbuff\n";
-								if (z_curr<=zbuffer[i][j]) {
-									zbuffer[i][j] = z_curr;
-									// std::cout<< ((bary_1*v1_col[0]/z1 + bary_2*v2_col[0]/z2 + bary_3*v3_col[0]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255<<" "<< ((bary_1*v1_col[1]/z1 + bary_2*v2_col[1]/z2 + bary_3*v3_col[1]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255<<" "<< ((bary_1*v1_col[2]/z1 + bary_2*v2_col[2]/z2 + bary_3*v3_col[2]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255<<" "<< ((bary_1*v1_col[3]/z1 + bary_2*v2_col[3]/z2 + bary_3*v3_col[3]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255 << "\n";
-									// std::cout<< ((bary_1*v1_col[0] + bary_2*v2_col[0] + bary_3*v3_col[0])/(bary_1 + bary_2 + bary_3))*255 << " " <<  ((bary_1*v1_col[1] + bary_2*v2_col[1] + bary_3*v3_col[1])/(bary_1 + bary_2 + bary_3))*255 << " " << ((bary_1*v1_col[2] + bary_2*v2_col[2] + bary_3*v3_col[2])/(bary_1 + bary_2 + bary_3))*255 << " " << ((bary_1*v1_col[3] + bary_2*v2_col[3] + bary_3*v3_col[3])/(bary_1 + bary_2 + bary_3))*255 << "\n\n";
-									// pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0] + bary_2*v2_col[0] + bary_3*v3_col[0])/(bary_1 + bary_2 + bary_3))*255, ((bary_1*v1_col[1] + bary_2*v2_col[1] + bary_3*v3_col[1])/(bary_1 + bary_2 + bary_3))*255, ((bary_1*v1_col[2] + bary_2*v2_col[2] + bary_3*v3_col[2])/(bary_1 + bary_2 + bary_3))*255, ((bary_1*v1_col[3] + bary_2*v2_col[3] + bary_3*v3_col[3])/(bary_1 + bary_2 + bary_3))*255);
-									// pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0]/z1 + bary_2*v2_col[0]/z2 + bary_3*v3_col[0]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255, ((bary_1*v1_col[1]/z1 + bary_2*v2_col[1]/z2 + bary_3*v3_col[1]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255, ((bary_1*v1_col[2]/z1 + bary_2*v2_col[2]/z2 + bary_3*v3_col[2]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255, ((bary_1*v1_col[3]/z1 + bary_2*v2_col[3]/z2 + bary_3*v3_col[3]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255);
-									pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0]/z_1 + bary_2*v2_col[0]/z_2 + bary_3*v3_col[0]/z_3)/(bary_1/z_1 + bary_2/z_2 + bary_3/z_3))*255, ((bary_1*v1_col[1]/z_1 + bary_2*v2_col[1]/z_2 + bary_3*v3_col[1]/z_3)/(bary_1/z_1 + bary_2/z_2 + bary_3/z_3))*255, ((bary_1*v1_col[2]/z_1 + bary_2*v2_col[2]/z_2 + bary_3*v3_col[2]/z_3)/(bary_1/z_1 + bary_2/z_2 + bary_3/z_3))*255, ((bary_1*v1_col[3]/z_1 + bary_2*v2_col[3]/z_2 + bary_3*v3_col[3]/z_3)/(bary_1/z_1 + bary_2/z_2 + bary_3/z_3))*255);
-									// pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0]/w1 + bary_2*v2_col[0]/w2 + bary_3*v3_col[0]/w3)/(bary_1/w1 + bary_2/w2 + bary_3/w3))*255, ((bary_1*v1_col[1]/w1 + bary_2*v2_col[1]/w2 + bary_3*v3_col[1]/w3)/(bary_1/w1 + bary_2/w2 + bary_3/w3))*255, ((bary_1*v1_col[2]/w1 + bary_2*v2_col[2]/w2 + bary_3*v3_col[2]/w3)/(bary_1/w1 + bary_2/w2 + bary_3/w3))*255, ((bary_1*v1_col[3]/w1 + bary_2*v2_col[3]/w2 + bary_3*v3_col[3]/w3)/(bary_1/w1 + bary_2/w2 + bary_3/w3))*255);
-									// pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0]*z1 + bary_2*v2_col[0]*z2 + bary_3*v3_col[0]*z3)/(bary_1*z1 + bary_2*z2 + bary_3*z3))*255, ((bary_1*v1_col[1]*z1 + bary_2*v2_col[1]*z2 + bary_3*v3_col[1]*z3)/(bary_1*z1 + bary_2*z2 + bary_3*z3))*255, ((bary_1*v1_col[2]*z1 + bary_2*v2_col[2]*z2 + bary_3*v3_col[2]*z3)/(bary_1*z1 + bary_2*z2 + bary_3*z3))*255, ((bary_1*v1_col[3]*z1 + bary_2*v2_col[3]*z2 + bary_3*v3_col[3]*z3)/(bary_1*z1 + bary_2*z2 + bary_3*z3))*255);
+		// Converts an NDC position to fixed-point screen coordinates (x right, y down).
+		// Returns false if the vertex lies outside the representable range.
+		bool snapToGrid(const glm::vec4 &ndc, int width, int height, long long &x, long long &y) {
+			float sx = (ndc[0] + 1)/2*width;
+			float sy = (1 - ndc[1])/2*height;
+			if (!(std::fabs(sx) < MAX_SCREEN_COORD && std::fabs(sy) < MAX_SCREEN_COORD))
+				return false;
+			x = (long long)std::floor(sx*SUBPIXEL_ONE + 0.5f);
+			y = (long long)std::floor(sy*SUBPIXEL_ONE + 0.5f);
+			return true;
+		}
+
+		// Integer division rounding towards negative infinity.
+		long long floorDiv(long long a, long long b) {
+			return a >= 0 ? a/b : -((-a + b - 1)/b);
+		}
+
+		// Returns the number of complete vertices in the object's attribute arrays.
+		int vertexCount(const Object &object) {
+			if (object.attributeDims.empty())
+				return 0;
+			int n = INT_MAX;
+			for (size_t i = 0; i < object.attributeDims.size(); i++)
+				n = std::min(n, (int)object.attributeValues[i].size()/object.attributeDims[i]);
+			return n;
+		}
+
+		// Sets up the edge function of the directed edge (xa, ya) -> (xb, yb):
+		// E(x, y) = a*x + b*y + c, which is positive on the inner side of a triangle with positive area.
+		void setupEdge(EdgeFunction &e, long long xa, long long ya, long long xb, long long yb) {
+			e.a = ya - yb;
+			e.b = xb - xa;
+			e.c = (yb - ya)*xa - (xb - xa)*ya;
+			// Top-left fill rule: a sample exactly on an edge is covered only if the edge is a
+			// top edge (horizontal, the triangle lies below it) or a left edge.
+			bool topLeft = (ya == yb && xb > xa) || (yb < ya);
+			e.bias = topLeft ? 0 : 1;
+		}
+
+		// Sets up the plane equation of an attribute with values A[k] at the vertices (X[k], Y[k])
+		// of a triangle with the given (positive) doubled area in fixed-point units.
+		void setupPlane(Plane &p, const long long X[3], const long long Y[3], long long area, const float A[3]) {
+			// gradient per sub-pixel unit, from the two edges leaving vertex 0
+			double dA1 = A[1] - A[0], dA2 = A[2] - A[0];
+			double ga = (dA1*(Y[2] - Y[0]) - dA2*(Y[1] - Y[0]))/area;
+			double gb = (dA2*(X[1] - X[0]) - dA1*(X[2] - X[0]))/area;
+			// pixel (i, j) has its centre at (i*SUBPIXEL_ONE + half, j*SUBPIXEL_ONE + half)
+			const double half = SUBPIXEL_ONE/2;
+			p.a = (float)(ga*SUBPIXEL_ONE);
+			p.b = (float)(gb*SUBPIXEL_ONE);
+			p.c = (float)(A[0] + ga*(half - X[0]) + gb*(half - Y[0]));
+		}
+
+		// Evaluates a plane equation at a point (x, y) given in pixels, where (i, j) is the centre of pixel (i, j).
+		// Rounds the same way as Simd::plane4() at pixel centres.
+		float evaluate(const Plane &p, float x, float y) {
+			return (p.c + p.b*y) + p.a*x;
+		}
+
+		// Converts a depth in the units of a z-buffer to the value it stores: integer depth formats
+		// (with depthMax > 0) clamp it to [0, depthMax] and round it like Simd::quantize4().
+		float quantizeDepth(float z, float depthMax) {
+			if (depthMax == 0)
+				return z;
+			return Simd::roundNearest(std::min(std::max(z, 0.0f), depthMax));
+		}
+
+		// Depth test of one fragment with depth z against the stored depth *depth, which is replaced
+		// if the test passes. If depthPass is set, the test is known to pass.
+		template <typename T> bool testDepth(T *depth, T z, bool depthPass) {
+			if (!depthPass && z > *depth)
+				return false;
+			*depth = z;
+			return true;
+		}
+
+		// Depth test of the fragments n in mask with depths z[n] against the stored depths row[n], which
+		// are replaced where the test passes. Returns the lanes that passed. Lanes outside mask are not
+		// accessed: they may belong to another thread's tile.
+		template <typename T, typename Z> int testDepth4(T *row, const Z z[4], int mask, bool depthPass) {
+			if (!depthPass) {
+				Z depth[4] = {0, 0, 0, 0};
+				for (int n = 0; n < 4; n++)
+					if (mask & (1 << n))
+						depth[n] = (Z)row[n];
+				mask = Simd::depthTest4(z, depth, mask);
+			}
+			for (int n = 0; n < 4; n++)
+				if (mask & (1 << n))
+					row[n] = (T)z[n];
+			return mask;
+		}
+
+		// Depth test of the samples s in mask with depths z[s] against the stored depths depth[s],
+		// which are replaced where the test passes. Returns the samples that passed.
+		template <typename T> int testSamples(T *depth, const float *z, int mask, bool depthPass) {
+			int passed = 0;
+			for (int s = 0; mask >> s; s++)
+				if ((mask & (1 << s)) && testDepth(depth + s, (T)z[s], depthPass))
+					passed |= 1 << s;
+			return passed;
+		}
 
+		// Shades pixel (i, j) of the triangle with multisampling, given the mask of its samples that
+		// are covered. Each covered sample is depth tested on its own, before the fragment stage
+		// (early-Z); the colour is then computed once for the pixel, and stored in the samples that
+		// passed. If depthPass is set, the depth test is known to pass.
+		void Rasterizer::shadePixel(const Triangle &tri, int i, int j, int coverage, bool depthPass, Stats &stats) {
+			const int n = supersampling_n;
+			int passed = coverage;
+			if (zbuffering) {
+				float z[MAX_SAMPLES];
+				for (int s = 0; s < n; s++)
+					if (coverage & (1 << s))
+						z[s] = quantizeDepth(evaluate(tri.z, i + samplePositions[s].x, j + samplePositions[s].y), depthMax);
+				unsigned char *depth = zbuffer + zstride*j + zbytes*n*i;
+				switch (depthFormat) {
+					case DepthFormat::D16:
+						passed = testSamples((Uint16*)depth, z, coverage, depthPass);
+						break;
+					case DepthFormat::D24:
+						passed = testSamples((Uint32*)depth, z, coverage, depthPass);
+						break;
+					case DepthFormat::D32F:
+						passed = testSamples((float*)depth, z, coverage, depthPass);
+						break;
+				}
+				if (!passed) {
+					stats.fragmentsKilledEarly++;
+					return;
+				}
+			}
+			stats.fragmentsShaded++;
+			// Interpolate at the pixel centre if the pixel is fully covered, and otherwise at the
+			// centroid of the covered samples, which lies inside the triangle.
+			float x = (float)i, y = (float)j;
+			if (coverage != (1 << n) - 1) {
+				glm::vec2 sum(0, 0);
+				int n_covered = 0;
+				for (int s = 0; s < n; s++)
+					if (coverage & (1 << s)) {
+						sum += samplePositions[s];
+						n_covered++;
+					}
+				x += sum.x/n_covered;
+				y += sum.y/n_covered;
+			}
+			float w = 1.0f/evaluate(tri.q, x, y);
+			float color[4];
+			for (int c = 0; c < 4; c++)
+				color[c] = evaluate(tri.col[c], x, y)*w;
+			Uint32 packed = Simd::pack(color, channelShift, channelMask);
+			Uint32 *samples = sampleColors.data() + (size_t)(i + framebuffer->w*j)*n;
+			for (int s = 0; s < n; s++)
+				if (passed & (1 << s))
+					samples[s] = packed;
+		}
+
+		// Shades the pixels (i+n, j) of the triangle for the lanes n set in mask, with a single sample
+		// per pixel (at its centre), written directly to the framebuffer.
+		void Rasterizer::shadeSpan4(const Triangle &tri, int i, int j, int mask, bool depthPass, Stats &stats) {
+			if (zbuffering) {
+				float z[4];
+				Simd::plane4(tri.z.a, tri.z.b, tri.z.c, i, j, z);
+				unsigned char *row = zbuffer + zstride*j + zbytes*i;
+				int passed = 0;
+				if (depthFormat == DepthFormat::D32F)
+					passed = testDepth4((float*)row, z, mask, depthPass);
+				else {
+					int zq[4];
+					Simd::quantize4(z, depthMax, zq);
+					if (depthFormat == DepthFormat::D16)
+						passed = testDepth4((Uint16*)row, zq, mask, depthPass);
+					else
+						passed = testDepth4((Uint32*)row, zq, mask, depthPass);
+				}
+				stats.fragmentsKilledEarly += Simd::count4(mask & ~passed);
+				mask = passed;
+				if (!mask)
+					return;
+			}
+			stats.fragmentsShaded += Simd::count4(mask);
+			float q[4], w[4], color[4][4];
+			Simd::plane4(tri.q.a, tri.q.b, tri.q.c, i, j, q);
+			Simd::reciprocal4(q, w);
+			for (int c = 0; c < 4; c++) {
+				Simd::plane4(tri.col[c].a, tri.col[c].b, tri.col[c].c, i, j, color[c]);
+				Simd::multiply4(color[c], w);
+			}
+
+			Uint32 packed[4];
+			Simd::pack4(color[0], color[1], color[2], color[3], channelShift, channelMask, packed);
+			Uint32 *pixels = (Uint32*)framebuffer->pixels + i + framebuffer->w*j;
+			for (int n = 0; n < 4; n++)
+				if (mask & (1 << n))
+					pixels[n] = packed[n];
+		}
+
+		// Bounds the depth of the triangle over the pixels [i0, i1] x [j0, j1] and their samples,
+		// as evaluated and stored by shadeSpan4() and shadePixel().
+		void depthBounds(const Triangle &tri, int i0, int i1, int j0, int j1, float depthMax, float &lo, float &hi) {
+			const Plane &p = tri.z;
+			float x0 = i0 - 0.5f, x1 = i1 + 0.5f, y0 = j0 - 0.5f, y1 = j1 + 0.5f;
+			lo = p.c + std::min(p.a*x0, p.a*x1) + std::min(p.b*y0, p.b*y1) - tri.z_err;
+			hi = p.c + std::max(p.a*x0, p.a*x1) + std::max(p.b*y0, p.b*y1) + tri.z_err;
+			// quantization is monotonic, so it preserves the bounds
+			lo = std::max(quantizeDepth(lo, depthMax), tri.z_min);
+			hi = std::min(quantizeDepth(hi, depthMax), tri.z_max);
+		}
+
+		// Bounds the depths stored as type T in the entries [i0, i1) x [j0, j1) of a z-buffer.
+		template <typename T> void storedDepthBounds(const unsigned char *zbuffer, size_t zstride, int i0, int i1, int j0, int j1, float &lo, float &hi) {
+			T zlo = ((const T*)(zbuffer + zstride*j0))[i0], zhi = zlo;
+			for (int j = j0; j < j1; j++) {
+				const T *row = (const T*)(zbuffer + zstride*j);
+				for (int i = i0; i < i1; i++) {
+					zlo = std::min(zlo, row[i]);
+					zhi = std::max(zhi, row[i]);
+				}
+			}
+			lo = (float)zlo;
+			hi = (float)zhi;
+		}
+
+		// Recomputes the Hi-Z bounds of the block with top-left pixel (bi, bj) from the z-buffer.
+		void Rasterizer::updateHiZ(int bi, int bj) {
+			int i1 = std::min(bi + BLOCK_SIZE, framebuffer->w), j1 = std::min(bj + BLOCK_SIZE, framebuffer->h);
+			int hiz = bi/BLOCK_SIZE + hizBlocksX*(bj/BLOCK_SIZE);
+			// every sample of the block
+			int s0 = bi*supersampling_n, s1 = i1*supersampling_n;
+			switch (depthFormat) {
+				case DepthFormat::D16:
+					storedDepthBounds<Uint16>(zbuffer, zstride, s0, s1, bj, j1, hizMin[hiz], hizMax[hiz]);
+					break;
+				case DepthFormat::D24:
+					storedDepthBounds<Uint32>(zbuffer, zstride, s0, s1, bj, j1, hizMin[hiz], hizMax[hiz]);
+					break;
+				case DepthFormat::D32F:
+					storedDepthBounds<float>(zbuffer, zstride, s0, s1, bj, j1, hizMin[hiz], hizMax[hiz]);
+					break;
+			}
+		}
+
+		// Rasterizes and shades the pixels of the triangle in [i_min, i_max] x [j_min, j_max].
+		// The range is walked in BLOCK_SIZE x BLOCK_SIZE blocks: blocks outside an edge are skipped,
+		// blocks inside all three edges are filled without per-pixel tests, and only the blocks
+		// crossing an edge are tested pixel by pixel.
+		void Rasterizer::rasterizeTriangle(const Triangle &tri, int i_min, int i_max, int j_min, int j_max, Stats &stats) {
+			const long long half = SUBPIXEL_ONE/2;
+
+			bool singleSample = supersampling_n == 1;
+			int allSamples = (1 << supersampling_n) - 1;
+
+			// Edge function values at the centre of pixel (i, j) are base + i*step_x + j*step_y,
+			// and at its sample s, sampleEdge[s] more.
+			long long base[3], step_x[3], step_y[3], bias[3];
+			long long sampleEdge[3][MAX_SAMPLES];
+			for (int k = 0; k < 3; k++) {
+				bias[k] = tri.edge[k].bias;
+				base[k] = tri.edge[k].a*half + tri.edge[k].b*half + tri.edge[k].c;
+				step_x[k] = tri.edge[k].a*SUBPIXEL_ONE;
+				step_y[k] = tri.edge[k].b*SUBPIXEL_ONE;
+				for (int s = 0; s < supersampling_n; s++)
+					sampleEdge[k][s] = tri.edge[k].a*sampleOffsets[s].x + tri.edge[k].b*sampleOffsets[s].y;
+			}
+			for (int bj = j_min - j_min % BLOCK_SIZE; bj <= j_max; bj += BLOCK_SIZE) {
+				int j0 = std::max(bj, j_min), j1 = std::min(bj + BLOCK_SIZE - 1, j_max);
+				for (int bi = i_min - i_min % BLOCK_SIZE; bi <= i_max; bi += BLOCK_SIZE) {
+					int i0 = std::max(bi, i_min), i1 = std::min(bi + BLOCK_SIZE - 1, i_max);
+					stats.blocksTested++;
+
+					// An edge function is linear, so its extremes over the samples of the block are at
+					// the corners of the block, offset by the extremes of the sample positions.
+					// Some sample must be inside for a pixel to be touched at all (reject), and
+					// every sample must be inside to skip the per-pixel tests (accept).
+					long long corner[3];
+					bool rejected = false, accepted = true;
+					for (int k = 0; k < 3; k++) {
+						corner[k] = base[k] + i0*step_x[k] + j0*step_y[k];
+						long long dx = (i1 - i0)*step_x[k], dy = (j1 - j0)*step_y[k];
+						long long hi = corner[k] + std::max(dx, 0LL) + std::max(dy, 0LL)
+						             + std::max(tri.edge[k].a*sampleMin.x, tri.edge[k].a*sampleMax.x)
+						             + std::max(tri.edge[k].b*sampleMin.y, tri.edge[k].b*sampleMax.y);
+						long long lo = corner[k] + std::min(dx, 0LL) + std::min(dy, 0LL)
+						             + std::min(tri.edge[k].a*sampleMin.x, tri.edge[k].a*sampleMax.x)
+						             + std::min(tri.edge[k].b*sampleMin.y, tri.edge[k].b*sampleMax.y);
+						if (hi < tri.edge[k].bias)
+							rejected = true;
+						if (lo < tri.edge[k].bias)
+							accepted = false;
+					}
+					if (rejected)
+						continue;
+
+					// Hi-Z: compare the depth range of the triangle over the block with that of the z-buffer.
+					int hiz = bi/BLOCK_SIZE + hizBlocksX*(bj/BLOCK_SIZE);
+					bool depthPass = false;
+					long long shaded = stats.fragmentsShaded;
+					if (zbuffering) {
+						float z_lo, z_hi;
+						depthBounds(tri, i0, i1, j0, j1, depthMax, z_lo, z_hi);
+						if (z_lo > hizMax[hiz]) {
+							stats.blocksHiZRejected++;
+							continue;
+						}
+						depthPass = z_hi <= hizMin[hiz];
+						if (depthPass)
+							stats.blocksHiZAccepted++;
+					}
+
+					if (accepted) {
+						stats.blocksAccepted++;
+						stats.pixelsCovered += (long long)(i1 - i0 + 1)*(j1 - j0 + 1);
+					}
+					long long row[3] = {corner[0], corner[1], corner[2]};
+					for (int j = j0; j <= j1; j++) {
+						if (singleSample) {
+							// 4 pixels at a time
+							long long e[3] = {row[0], row[1], row[2]};
+							for (int i = i0; i <= i1; i += 4) {
+								int lanes = std::min(4, i1 - i + 1);
+								int mask = (1 << lanes) - 1;
+								if (!accepted) {
+									stats.pixelsTested += lanes;
+									mask &= Simd::coverage4(e, step_x, bias);
+									stats.pixelsCovered += Simd::count4(mask);
 								}
-								else {continue;}
+								if (mask)
+									shadeSpan4(tri, i, j, mask, depthPass, stats);
+								e[0] += 4*step_x[0]; e[1] += 4*step_x[1]; e[2] += 4*step_x[2];
 							}
-							else {
-								// std::cout<< ((bary_1*v1_col[0]/z1 + bary_2*v2_col[0]/z2 + bary_3*v3_col[0]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255<<" "<< ((bary_1*v1_col[1]/z1 + bary_2*v2_col[1]/z2 + bary_3*v3_col[1]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255<<" "<< ((bary_1*v1_col[2]/z1 + bary_2*v2_col[2]/z2 + bary_3*v3_col[2]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255<<" "<< ((bary_1*v1_col[3]/z1 + bary_2*v2_col[3]/z2 + bary_3*v3_col[3]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255 << "\n";
-								// pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0]/z1 + bary_2*v2_col[0]/z2 + bary_3*v3_col[0]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255, ((bary_1*v1_col[1]/z1 + bary_2*v2_col[1]/z2 + bary_3*v3_col[1]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255, ((bary_1*v1_col[2]/z1 + bary_2*v2_col[2]/z2 + bary_3*v3_col[2]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255, ((bary_1*v1_col[3]/z1 + bary_2*v2_col[3]/z2 + bary_3*v3_col[3]/z3)/(bary_1/z1 + bary_2/z2 + bary_3/z3))*255);
-								pixels[i + width*j] = SDL_MapRGBA(format, ((bary_1*v1_col[0] + bary_2*v2_col[0] + bary_3*v3_col[0])/(bary_1 + bary_2 + bary_3))*255, ((bary_1*v1_col[1] + bary_2*v2_col[1] + bary_3*v3_col[1])/(bary_1 + bary_2 + bary_3))*255, ((bary_1*v1_col[2] + bary_2*v2_col[2] + bary_3*v3_col[2])/(bary_1 + bary_2 + bary_3))*255, ((bary_1*v1_col[3] + bary_2*v2_col[3] + bary_3*v3_col[3])/(bary_1 + bary_2 + bary_3))*255);
+							row[0] += step_y[0]; row[1] += step_y[1]; row[2] += step_y[2];
+							continue;
+						}
+						long long e0 = row[0], e1 = row[1], e2 = row[2];
+						for (int i = i0; i <= i1; i++, e0 += step_x[0], e1 += step_x[1], e2 += step_x[2]) {
+							int coverage = allSamples;
+							if (!accepted) {
+								stats.pixelsTested++;
+								coverage = 0;
+								for (int s = 0; s < supersampling_n; s++)
+									if (e0 + sampleEdge[0][s] >= bias[0] && e1 + sampleEdge[1][s] >= bias[1] && e2 + sampleEdge[2][s] >= bias[2])
+										coverage |= 1 << s;
+								if (!coverage)
+									continue;
+								stats.pixelsCovered++;
 							}
-							
-
+							shadePixel(tri, i, j, coverage, depthPass, stats);
 						}
-						
-						// std::cout << "Barry : " << bary_1 << " " << bary_2 << " "<< bary_3 << "\n";
-						// float x = (i + 0.5)/width;  // [0, w] -> [0, 1]
-						// x = 2*x - 1;                     // [0, 1] -> [-1, 1]
-						// float y = (j + 0.5)/height; // [0, h] -> [0, 1]
-						// y = 1 - 2*y;                     // [0, 1] -> [1, -1]
-						// // Uint32 colorij = SDL_MapRGBA(format, v1_col[0]*255, v1_col[1]*255, v1_col[2]*255, v1_col[3]*255); 
-						// if (c_left_or_right>=0) {
-						// 	if (-(y2-y1)*(x-x1)+(x2-x1)*(y-y1)>=0 && -(y3-y2)*(x-x2)+(x3-x2)*(y-y2)>=0 && -(y1-y3)*(x-x3)+(x1-x3)*(y-y3)>=0){
-						// 		float total = glm::length(glm::cross(glm::vec3(v1_ndc[0]-v2_ndc[0], v1_ndc[1]-v2_ndc[1],0), glm::vec3(v3_ndc[0]-v2_ndc[0], v3_ndc[1]-v2_ndc[1],0)));
-						// 		float bary_1 = glm::length(glm::cross(glm::vec3(v2_ndc[0]-x, v2_ndc[1]-y,0), glm::vec3(v3_ndc[0]-x, v3_ndc[1]-y,0)))/total;
-						// 		float bary_2 = glm::length(glm::cross(glm::vec3(v3_ndc[0]-x, v3_ndc[1]-y,0), glm::vec3(v1_ndc[0]-x, v1_ndc[1]-y,0)))/total;
-						// 		float bary_3 = glm::length(glm::cross(glm::vec3(v1_ndc[0]-x, v1_ndc[1]-y,0), glm::vec3(v2_ndc[0]-x, v2_ndc[1]-y,0)))/total;
-						// 		// std::cout << "BARRRYY : " << bary_1+bary_2+bary_3 << "\n";	
-						// 		pixels[i + width*j] = SDL_MapRGBA(format, (bary_1*v1_col[0] + bary_2*v2_col[0] + bary_3*v3_col[0])*255, (bary_1*v1_col[1] + bary_2*v2_col[1] + bary_3*v3_col[1])*255, (bary_1*v1_col[2] + bary_2*v2_col[2] + bary_3*v3_col[2])*255, (bary_1*v1_col[3] + bary_2*v2_col[3] + bary_3*v3_col[3])*255);
-						// 	} 
-						// }
-						// else {
-						// 	if (-(y2-y1)*(x-x1)+(x2-x1)*(y-y1)<=0 && -(y3-y2)*(x-x2)+(x3-x2)*(y-y2)<=0 && -(y1-y3)*(x-x3)+(x1-x3)*(y-y3)<=0){
-						// 		float total = glm::length(glm::cross(glm::vec3(v1_ndc[0]-v2_ndc[0], v1_ndc[1]-v2_ndc[1],0), glm::vec3(v3_ndc[0]-v2_ndc[0], v3_ndc[1]-v2_ndc[1],0)));
-						// 		float bary_1 = glm::length(glm::cross(glm::vec3(v2_ndc[0]-x, v2_ndc[1]-y,0), glm::vec3(v3_ndc[0]-x, v3_ndc[1]-y,0)))/total;
-						// 		float bary_2 = glm::length(glm::cross(glm::vec3(v3_ndc[0]-x, v3_ndc[1]-y,0), glm::vec3(v1_ndc[0]-x, v1_ndc[1]-y,0)))/total;
-						// 		float bary_3 = glm::length(glm::cross(glm::vec3(v1_ndc[0]-x, v1_ndc[1]-y,0), glm::vec3(v2_ndc[0]-x, v2_ndc[1]-y,0)))/total;
-						// 		// std::cout << "BARRRYY : " << bary_1+bary_2+bary_3 << "\n";	
-						// 		pixels[i + width*j] = SDL_MapRGBA(format, (bary_1*v1_col[0] + bary_2*v2_col[0] + bary_3*v3_col[0])*255, (bary_1*v1_col[1] + bary_2*v2_col[1] + bary_3*v3_col[1])*255, (bary_1*v1_col[2] + bary_2*v2_col[2] + bary_3*v3_col[2])*255, (bary_1*v1_col[3] + bary_2*v2_col[3] + bary_3*v3_col[3])*255);
-						// 	} 
-						// }
-						
+						row[0] += step_y[0]; row[1] += step_y[1]; row[2] += step_y[2];
+					}
+					if (zbuffering && stats.fragmentsShaded != shaded)
+						updateHiZ(bi, bj);
+				}
+			}
+		}
+
+		// State of triangle setup that is constant over a draw.
+		struct SetupParams {
+			int width, height;             // viewport size
+			int cull;                      // sign of the screen-space area of culled triangles, or 0
+			float depthMax;                // range of integer depth formats, 0 for float depth
+			glm::ivec2 sampleMin, sampleMax;   // bounds of the sample offsets from the pixel centre
+		};
+
+		// Sets up a triangle with clip-space vertices in front of the camera for rasterization:
+		// perspective division, snapping, edge functions and attribute planes.
+		// Depth is mapped from [-1, 1] to [0, depthMax] for integer depth formats (depthMax > 0).
+		// Returns false if no pixel of the viewport has a sample it can cover, or if cull is
+		// nonzero and the sign of its area on the screen (positive if clockwise) equals cull.
+		bool setupTriangle(const ShadedVertex &v0, const ShadedVertex &v1, const ShadedVertex &v2,
+		                   const SetupParams &params, Triangle &tri, Stats &stats) {
+			const int width = params.width, height = params.height;
+			const float depthMax = params.depthMax;
+			const ShadedVertex *v[3] = {&v0, &v1, &v2};
+			// To support 3D triangles, we include the perspective division stage after the vertex shader
+			glm::vec4 ndc[3], col[3];
+			float q[3];    // 1/w, for perspective-correct colours
+			float zn[3];   // NDC depth, for the z-buffer
+			for (int k = 0; k < 3; k++) {
+				const glm::vec4 &p = v[k]->position;
+				q[k] = 1.0f/p[3];
+				ndc[k] = glm::vec4(p[0]*q[k], p[1]*q[k], p[2]*q[k], 1.0);
+				zn[k] = ndc[k][2];
+				col[k] = v[k]->color;
+			}
+
+			// Triangle setup: snap the vertices to the sub-pixel grid, build the edge functions
+			// and the plane equations of the interpolated attributes.
+			long long X[3], Y[3];
+			if (!snapToGrid(ndc[0], width, height, X[0], Y[0]) ||
+			    !snapToGrid(ndc[1], width, height, X[1], Y[1]) ||
+			    !snapToGrid(ndc[2], width, height, X[2], Y[2]))
+				return false;
+			long long area = (X[1]-X[0])*(Y[2]-Y[0]) - (Y[1]-Y[0])*(X[2]-X[0]);
+			if (area == 0)
+				return false;
+			if ((area > 0 ? 1 : -1) == params.cull) {
+				stats.trianglesCulled++;
+				return false;
+			}
+			// Rasterize both windings with the same code by making the area positive.
+			if (area < 0) {
+				std::swap(X[1], X[2]); std::swap(Y[1], Y[2]);
+				std::swap(col[1], col[2]); std::swap(q[1], q[2]); std::swap(zn[1], zn[2]);
+				area = -area;
+			}
+			// The edge opposite vertex k is edge[k], so that edge[k](v_k) = area and
+			// edge[k]/area is the barycentric coordinate of vertex k.
+			setupEdge(tri.edge[0], X[1], Y[1], X[2], Y[2]);
+			setupEdge(tri.edge[1], X[2], Y[2], X[0], Y[0]);
+			setupEdge(tri.edge[2], X[0], Y[0], X[1], Y[1]);
+			// Depth and 1/w are linear in screen space, and so are the colours once divided by w.
+			if (depthMax > 0)
+				for (int k = 0; k < 3; k++)
+					zn[k] = (zn[k]*0.5f + 0.5f)*depthMax;
+			setupPlane(tri.z, X, Y, area, zn);
+			// Each term of the evaluation is rounded once, and the pixel coordinates lie within the viewport.
+			tri.z_err = 4*FLT_EPSILON*(std::fabs(tri.z.c) + std::fabs(tri.z.a)*width + std::fabs(tri.z.b)*height);
+			tri.z_min = quantizeDepth(std::min(zn[0], std::min(zn[1], zn[2])) - tri.z_err, depthMax);
+			tri.z_max = quantizeDepth(std::max(zn[0], std::max(zn[1], zn[2])) + tri.z_err, depthMax);
+			setupPlane(tri.q, X, Y, area, q);
+			for (int c = 0; c < 4; c++) {
+				float cq[3] = {col[0][c]*q[0], col[1][c]*q[1], col[2][c]*q[2]};
+				setupPlane(tri.col[c], X, Y, area, cq);
+			}
+
+			// Only pixels with samples that can lie inside the triangle need to be visited:
+			// its screen-space bounding box, clipped to the viewport.
+			// Pixel (i, j) has its centre at (i + 1/2, j + 1/2), and its samples at the sample offsets from it.
+			const long long half = SUBPIXEL_ONE/2;
+			long long x_lo = std::min(X[0], std::min(X[1], X[2])), x_hi = std::max(X[0], std::max(X[1], X[2]));
+			long long y_lo = std::min(Y[0], std::min(Y[1], Y[2])), y_hi = std::max(Y[0], std::max(Y[1], Y[2]));
+			x_lo -= half + params.sampleMax.x; x_hi -= half + params.sampleMin.x;
+			y_lo -= half + params.sampleMax.y; y_hi -= half + params.sampleMin.y;
+			tri.i_min = (int)std::max(floorDiv(x_lo + SUBPIXEL_ONE - 1, SUBPIXEL_ONE), 0LL);
+			tri.i_max = (int)std::min(floorDiv(x_hi, SUBPIXEL_ONE), (long long)width - 1);
+			tri.j_min = (int)std::max(floorDiv(y_lo + SUBPIXEL_ONE - 1, SUBPIXEL_ONE), 0LL);
+			tri.j_max = (int)std::min(floorDiv(y_hi, SUBPIXEL_ONE), (long long)height - 1);
+			return tri.i_min <= tri.i_max && tri.j_min <= tri.j_max;
+		}
+
+		// Returns the mask of the planes (of which there are n) that p lies strictly outside of,
+		// where p is inside plane k if dot(planes[k], p) >= 0.
+		int outcode(const glm::vec4 &p, const glm::vec4 *planes, int n) {
+			int code = 0;
+			for (int k = 0; k < n; k++)
+				if (glm::dot(planes[k], p) < 0)
+					code |= 1 << k;
+			return code;
+		}
+
+		// Clips the convex polygon poly[0..n) against the half-space dot(plane, p) >= 0, interpolating
+		// the attributes of new vertices linearly in clip space. Writes the result to out and
+		// returns its number of vertices.
+		int clipPolygon(const ShadedVertex *poly, int n, const glm::vec4 &plane, ShadedVertex *out) {
+			int m = 0;
+			for (int k = 0; k < n; k++) {
+				const ShadedVertex &a = poly[k], &b = poly[(k+1) % n];
+				float da = glm::dot(plane, a.position), db = glm::dot(plane, b.position);
+				if (da >= 0)
+					out[m++] = a;
+				if ((da >= 0) != (db >= 0)) {
+					float t = da/(da - db);
+					out[m].position = a.position + t*(b.position - a.position);
+					out[m].color = a.color + t*(b.color - a.color);
+					m++;
+				}
+			}
+			return m;
+		}
+
+		// Rasterizes the binned triangles of the k'th active tile, in API order.
+		void Rasterizer::rasterizeTile(int k) {
+			int t = activeTiles[k];
+			int tx = t % tilesX, ty = t / tilesX;
+			int i0 = tx*TILE_SIZE, i1 = std::min(i0 + TILE_SIZE, framebuffer->w) - 1;
+			int j0 = ty*TILE_SIZE, j1 = std::min(j0 + TILE_SIZE, framebuffer->h) - 1;
+			// The farthest depth in the tile when the draw starts; it can only get nearer during the draw.
+			float tileMax = -FLT_MAX;
+			if (zbuffering)
+				for (int bj = j0; bj <= j1; bj += BLOCK_SIZE)
+					for (int bi = i0; bi <= i1; bi += BLOCK_SIZE)
+						tileMax = std::max(tileMax, hizMax[bi/BLOCK_SIZE + hizBlocksX*(bj/BLOCK_SIZE)]);
+			for (size_t n = 0; n < bins[t].size(); n++) {
+				const Triangle &tri = triangles[bins[t][n]];
+				if (zbuffering && tri.z_min > tileMax) {
+					tileStats[k].trianglesHiZRejected++;
+					continue;
+				}
+				rasterizeTriangle(tri, std::max(tri.i_min, i0), std::min(tri.i_max, i1),
+				                  std::max(tri.j_min, j0), std::min(tri.j_max, j1), tileStats[k]);
+			}
+		}
+
+		// 
+		void Rasterizer::drawObject(const Object &object){
+			if (activeProgram == NULL)
+				return;
+			shadeVertices(object, activeProgram->uniforms, activeProgram->vs, activeProgram->fs);
+			drawShaded(object);
+		}
+
+		// Assembles, sets up, bins and rasterizes the triangles of the object, whose vertices are shadedVertices.
+		void Rasterizer::drawShaded(const Object &object) {
+			// The viewport is the framebuffer, which clear() keeps the size of the window.
+			int width = framebuffer->w, height = framebuffer->h;
+			int n_vertices = (int)shadedVertices.size();
+
+			// Clip-space planes, as p is inside plane k if dot(planes[k], p) >= 0: the near and far planes,
+			// then either the sides of the view frustum or the guard band around them.
+			float gx = 1 + 2*GUARD_BAND/width, gy = 1 + 2*GUARD_BAND/height;
+			const glm::vec4 frustumPlanes[6] = {
+				glm::vec4(0, 0, 1, 1), glm::vec4(0, 0, -1, 1),
+				glm::vec4(1, 0, 0, 1), glm::vec4(-1, 0, 0, 1), glm::vec4(0, 1, 0, 1), glm::vec4(0, -1, 0, 1)
+			};
+			const glm::vec4 clipPlanes[6] = {
+				glm::vec4(0, 0, 1, 1), glm::vec4(0, 0, -1, 1),
+				glm::vec4(1, 0, 0, gx), glm::vec4(-1, 0, 0, gx), glm::vec4(0, 1, 0, gy), glm::vec4(0, -1, 0, gy)
+			};
+
+			// Screen y points down, so a triangle that is clockwise on the screen has a positive area.
+			// Culling rejects the triangles whose area has the sign params.cull.
+			SetupParams params;
+			params.width = width;
+			params.height = height;
+			params.cull = 0;
+			if (faceCulling) {
+				bool cullClockwise = (frontFace == Winding::Clockwise) == (culledFace == Face::Front);
+				params.cull = cullClockwise ? 1 : -1;
+			}
+			params.depthMax = depthMax;
+			params.sampleMin = sampleMin;
+			params.sampleMax = sampleMax;
+
+			// Triangle assembly reads the shaded vertices through the index buffer.
+			triangles.clear();
+			for (size_t t = 0; t < object.indices.size(); t++) {
+				const glm::ivec3 &index = object.indices[t];
+				if (index.x < 0 || index.x >= n_vertices || index.y < 0 || index.y >= n_vertices || index.z < 0 || index.z >= n_vertices)
+					continue;
+
+				const ShadedVertex &v0 = shadedVertices[index.x], &v1 = shadedVertices[index.y], &v2 = shadedVertices[index.z];
+
+				// Reject the triangle if all its vertices are outside the same frustum plane.
+				int outside = outcode(v0.position, frustumPlanes, 6) & outcode(v1.position, frustumPlanes, 6) & outcode(v2.position, frustumPlanes, 6);
+				if (outside) {
+					stats.trianglesRejected++;
+					continue;
+				}
+				// Most triangles lie in front of the camera and within the guard band, and need no clipping.
+				int crossed = outcode(v0.position, clipPlanes, 6) | outcode(v1.position, clipPlanes, 6) | outcode(v2.position, clipPlanes, 6);
+				Triangle tri;
+				if (!crossed) {
+					if (setupTriangle(v0, v1, v2, params, tri, stats))
+						triangles.push_back(tri);
+					continue;
+				}
+				// Otherwise clip it against the planes it crosses, and split the resulting polygon
+				// into a fan of triangles with the original winding.
+				stats.trianglesClipped++;
+				ShadedVertex poly[2][MAX_CLIPPED_VERTICES] = {{v0, v1, v2}};
+				int n = 3, cur = 0;
+				for (int k = 0; k < 6 && n >= 3; k++) {
+					if (crossed & (1 << k)) {
+						n = clipPolygon(poly[cur], n, clipPlanes[k], poly[1-cur]);
+						cur = 1 - cur;
 					}
 				}
+				for (int k = 1; k + 1 < n; k++)
+					if (setupTriangle(poly[cur][0], poly[cur][k], poly[cur][k+1], params, tri, stats))
+						triangles.push_back(tri);
+			}
+
+			// Binning: sort the triangles into the screen tiles their bounding boxes overlap.
+			// Every tile keeps its triangles in API order, so each pixel is still written in draw order.
+			bins.resize(tileStates.size());
+			for (size_t t = 0; t < bins.size(); t++)
+				bins[t].clear();
+			for (size_t k = 0; k < triangles.size(); k++) {
+				const Triangle &tri = triangles[k];
+				for (int ty = tri.j_min/TILE_SIZE; ty <= tri.j_max/TILE_SIZE; ty++)
+					for (int tx = tri.i_min/TILE_SIZE; tx <= tri.i_max/TILE_SIZE; tx++)
+						bins[tx + tilesX*ty].push_back((int)k);
+			}
+			activeTiles.clear();
+			for (size_t t = 0; t < bins.size(); t++)
+				if (!bins[t].empty())
+					activeTiles.push_back((int)t);
+
+			// Rasterize the tiles in parallel. Tiles are disjoint, so no two threads touch the same pixel.
+			tileStats.assign(activeTiles.size(), Stats());
+			pool->run((int)activeTiles.size(), [this](int k) {
+				int t = activeTiles[k];
+				if (tileStates[t] == TILE_PENDING)
+					fillTile(t);
+				tileStates[t] = TILE_DRAWN;
+				rasterizeTile(k);
+			});
+			for (size_t k = 0; k < tileStats.size(); k++) {
+				stats.pixelsTested += tileStats[k].pixelsTested;
+				stats.pixelsCovered += tileStats[k].pixelsCovered;
+				stats.blocksTested += tileStats[k].blocksTested;
+				stats.blocksAccepted += tileStats[k].blocksAccepted;
+				stats.fragmentsKilledEarly += tileStats[k].fragmentsKilledEarly;
+				stats.trianglesHiZRejected += tileStats[k].trianglesHiZRejected;
+				stats.blocksHiZRejected += tileStats[k].blocksHiZRejected;
+				stats.blocksHiZAccepted += tileStats[k].blocksHiZAccepted;
+				stats.fragmentsShaded += tileStats[k].fragmentsShaded;
 			}
 			// SDL_BlitScaled(framebuffer, NULL, windowSurface, NULL);
 			// SDL_UpdateWindowSurface(window);
 			return;
 		}
 
+		// Averages n packed pixels (n a power of 2 up to 256) channel by channel, rounding to nearest.
+		// Works on any format with 8 bits per byte-aligned channel, two channels at a time.
+		Uint32 averagePixels(const Uint32 *p, int n) {
+			int log2n = 0;
+			while ((1 << log2n) < n)
+				log2n++;
+			Uint32 even = 0, odd = 0;
+			for (int s = 0; s < n; s++) {
+				even += p[s] & 0x00ff00ff;
+				odd += (p[s] >> 8) & 0x00ff00ff;
+			}
+			Uint32 round = (Uint32)(n/2)*0x00010001;
+			even = ((even + round) >> log2n) & 0x00ff00ff;
+			odd = ((odd + round) >> log2n) & 0x00ff00ff;
+			return even | (odd << 8);
+		}
+
+		// Brings the framebuffer up to date: fills the tiles still pending a clear, and resolves the
+		// samples of the tiles drawn to, each pixel getting the average of its samples' colours.
+		void Rasterizer::resolve() {
+			activeTiles.clear();
+			for (size_t t = 0; t < tileStates.size(); t++) {
+				if (tileStates[t] == TILE_PENDING || (tileStates[t] == TILE_DRAWN && supersampling_n > 1))
+					activeTiles.push_back((int)t);
+				else if (tileStates[t] == TILE_DRAWN)
+					tileStates[t] = TILE_RESOLVED;
+			}
+			pool->run((int)activeTiles.size(), [this](int k) {
+				int t = activeTiles[k];
+				if (tileStates[t] == TILE_PENDING) {
+					fillTile(t);
+					tileStates[t] = TILE_CLEAR;
+					return;
+				}
+				tileStates[t] = TILE_RESOLVED;
+				int width = framebuffer->w, n = supersampling_n;
+				int i0 = (t % tilesX)*TILE_SIZE, i1 = std::min(i0 + TILE_SIZE, width);
+				int j0 = (t / tilesX)*TILE_SIZE, j1 = std::min(j0 + TILE_SIZE, framebuffer->h);
+				for (int j = j0; j < j1; j++) {
+					Uint32 *pixels = (Uint32*)framebuffer->pixels + width*j;
+					const Uint32 *samples = sampleColors.data() + (size_t)width*j*n;
+					for (int i = i0; i < i1; i++)
+						pixels[i] = averagePixels(samples + i*n, n);
+				}
+			});
+		}
+
+		// Fills tile t of the framebuffer, and its samples, with the clear colour.
+		void Rasterizer::fillTile(int t) {
+			int width = framebuffer->w, n = supersampling_n;
+			int i0 = (t % tilesX)*TILE_SIZE, i1 = std::min(i0 + TILE_SIZE, width);
+			int j0 = (t / tilesX)*TILE_SIZE, j1 = std::min(j0 + TILE_SIZE, framebuffer->h);
+			for (int j = j0; j < j1; j++) {
+				Simd::fill32((Uint32*)framebuffer->pixels + width*j + i0, (size_t)(i1 - i0)*4, clearColor);
+				if (n > 1)
+					Simd::fill32(sampleColors.data() + ((size_t)width*j + i0)*n, (size_t)(i1 - i0)*n*4, clearColor);
+			}
+		}
+
+		// (Re)allocates the framebuffer(s), and the samples, for a width x height viewport.
+		// Their contents are undefined until the next clear(). Offscreen, the framebuffer stores
+		// RGBA bytes, so that readPixels() can copy it as is.
+		void Rasterizer::resizeFramebuffer(int width, int height) {
+			if (window != NULL) {
+				// presents the frames in flight before freeing the old framebuffers
+				int n = presenter ? presenter->size() : 1;
+				framebuffer = NULL;
+				presenter.reset();
+				presenter.reset(new Presenter(window, width, height, std::max(n, 1)));
+				framebuffer = presenter->acquire();
+			}
+			else {
+				SDL_FreeSurface(framebuffer);
+				framebuffer = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+			}
+			if (framebuffer == NULL)
+				return;
+			Simd::channelLayout(framebuffer->format, channelShift, channelMask);
+			if (supersampling_n > 1)
+				sampleColors.resize((size_t)width*height*supersampling_n);
+			tilesX = (width + TILE_SIZE - 1)/TILE_SIZE;
+			tileStates.assign(tilesX*((height + TILE_SIZE - 1)/TILE_SIZE), TILE_PENDING);
+			clearColor = 0;
+		}
+
 		void Rasterizer::show(){
-			SDL_Surface* windowSurface = SDL_GetWindowSurface(window);
-			SDL_BlitScaled(framebuffer, NULL, windowSurface, NULL);
-            SDL_UpdateWindowSurface(window);
+			resolve();
+			if (sequenceActive) {
+				static const char *extensions[3] = {".raw", ".ppm", ".png"};
+				char number[16];
+				snprintf(number, sizeof(number), "%05d", sequenceFrame++);
+				saveFrame(sequencePrefix + number + extensions[(int)sequenceFormat], sequenceFormat);
+			}
+			if (window == NULL)
+				return;
+			// With several framebuffers, the next frame is rendered into another one while this
+			// one is presented; its tiles hold nothing known.
+			presenter->present(framebuffer, frameStart);
+			SDL_Surface *next = presenter->acquire();
+			if (next != framebuffer) {
+				framebuffer = next;
+				std::fill(tileStates.begin(), tileStates.end(), TILE_PENDING);
+			}
 
 			SDL_Event e;
 			// when we click (x) on the window, that is a poll event
@@ -522,31 +1163,168 @@ namespace COL781 {
 			}
 		}
 
+		// Copies a rectangle of pixels of the current frame into rgba, as R, G, B, A bytes.
+		bool Rasterizer::readPixels(int x, int y, int width, int height, Uint8 *rgba) {
+			if (x < 0 || y < 0 || width < 0 || height < 0 || x + width > framebuffer->w || y + height > framebuffer->h)
+				return false;
+			resolve();
+			for (int j = 0; j < height; j++) {
+				const Uint32 *row = (const Uint32*)framebuffer->pixels + framebuffer->w*(y + j) + x;
+				Uint8 *out = rgba + (size_t)4*width*j;
+				if (framebuffer->format->format == SDL_PIXELFORMAT_RGBA32) {
+					std::memcpy(out, row, (size_t)4*width);
+					continue;
+				}
+				for (int i = 0; i < width; i++)
+					for (int c = 0; c < 4; c++)
+						out[4*i + c] = channelMask[c] ? (Uint8)((row[i] & channelMask[c]) >> channelShift[c]) : 255;
+			}
+			return true;
+		}
+
+		// Sets the number of framebuffers frames are presented from (1 to 3).
+		void Rasterizer::setPresentBuffers(int n) {
+			n = std::min(std::max(n, 1), 3);
+			if (window == NULL || (presenter && presenter->size() == n))
+				return;
+			int width = framebuffer->w, height = framebuffer->h;
+			framebuffer = NULL;
+			presenter.reset();
+			presenter.reset(new Presenter(window, width, height, n));
+			framebuffer = presenter->acquire();
+			std::fill(tileStates.begin(), tileStates.end(), TILE_PENDING);
+		}
+
+		// Returns the presentation counters of the window.
+		PresentStats Rasterizer::getPresentStats() const {
+			return presenter ? presenter->getStats() : PresentStats();
+		}
+
+		// Copies the current frame into the next free frame buffer, and queues it for writing.
+		void Rasterizer::saveFrame(const std::string &path, ImageFormat format) {
+			if (!frameWriter)
+				frameWriter.reset(new FrameWriter(FRAME_BUFFERS));
+			FrameWriter::Frame &frame = frameWriter->acquire();
+			frame.path = path;
+			frame.format = format;
+			frame.width = framebuffer->w;
+			frame.height = framebuffer->h;
+			frame.rgba.resize((size_t)frame.width*frame.height*4);
+			readPixels(0, 0, frame.width, frame.height, frame.rgba.data());
+			frameWriter->submit();
+		}
+
+		void Rasterizer::startFrameSequence(const std::string &prefix, ImageFormat format, int first) {
+			sequenceActive = true;
+			sequencePrefix = prefix;
+			sequenceFormat = format;
+			sequenceFrame = first;
+		}
+
+		void Rasterizer::stopFrameSequence() {
+			sequenceActive = false;
+		}
+
+		void Rasterizer::flushFrames() {
+			if (frameWriter)
+				frameWriter->flush();
+		}
+
+		// Sets the number of threads used to rasterize (0 picks one per hardware thread).
+		void Rasterizer::setThreadCount(int n) {
+			if (n <= 0)
+				n = std::max(1u, std::thread::hardware_concurrency());
+			if (pool && pool->size() == n)
+				return;
+			pool.reset(new ThreadPool(n));
+		}
+
+		// Returns the work counters accumulated since the last clear().
+		Stats Rasterizer::getStats() const {
+			Stats s = stats;
+			long long count = allocationCount();
+			s.allocations = count < 0 ? -1 : count - frameAllocations;
+			return s;
+		}
+
+		// Prints the work counters of the current frame to standard output.
+		void Rasterizer::printStats() const {
+			Stats stats = getStats();
+			std::cout << "vertices shaded: " << stats.verticesShaded
+			          << ", triangles rejected: " << stats.trianglesRejected
+			          << ", triangles clipped: " << stats.trianglesClipped
+			          << ", triangles culled: " << stats.trianglesCulled
+			          << ", blocks tested: " << stats.blocksTested
+			          << ", blocks fully covered: " << stats.blocksAccepted
+			          << ", pixels tested: " << stats.pixelsTested
+			          << ", pixels covered: " << stats.pixelsCovered
+			          << ", Hi-Z rejected triangles/tile: " << stats.trianglesHiZRejected
+			          << ", Hi-Z rejected blocks: " << stats.blocksHiZRejected
+			          << ", Hi-Z accepted blocks: " << stats.blocksHiZAccepted
+			          << ", fragments killed early: " << stats.fragmentsKilledEarly
+			          << ", fragments shaded: " << stats.fragmentsShaded;
+			if (stats.allocations >= 0)
+				std::cout << ", allocations: " << stats.allocations;
+			if (stats.pixelsCovered > 0)
+				std::cout << ", tested/covered: " << (double)stats.pixelsTested/stats.pixelsCovered;
+			std::cout << std::endl;
+		}
+
 		// Deletes the given shader program.
+		// Nothing is drawn while no program is active, as after deleting the active one.
 		void Rasterizer::deleteShaderProgram(ShaderProgram &program) {
-			// std::cout << "Deleted!\n";
-			program.fs=NULL;
-			program.vs=NULL;
-			program.uniforms=Uniforms();
-						// std::cout << "Deleted1!\n";
-			return;
+			Program *p = getProgram(program);
+			if (p != NULL) {
+				if (activeProgram == p)
+					activeProgram = NULL;
+				programs[program.id].reset();
+			}
+			program.id = -1;
 		}
 
 		// Enable depth testing.
 		void Rasterizer::enableDepthTest(){
-			int width, height;
-    		SDL_GetWindowSize(window, &width, &height);
-			// std::cout << "width height" << width << " " << height << "\n";
-			for (int i=0; i<width; i++){
-				std::vector<float> v;
-				for (int j=0; j<height; j++){
-					v.push_back(FLT_MAX);
-					// std::cout << v[j] << "\n";
-				}
-				zbuffer.push_back(v);
-			}
 			zbuffering = true;
-			// std::cout << "enabled\n";
+		}
+
+		// Sets the format of the z-buffer, and clears it.
+		void Rasterizer::setDepthFormat(DepthFormat format) {
+			depthFormat = format;
+			resizeDepthBuffer(zwidth, zheight);
+		}
+
+		// (Re)allocates the z-buffer (with every sample of every pixel) and its Hi-Z bounds for a
+		// width x height viewport, and clears them.
+		void Rasterizer::resizeDepthBuffer(int width, int height) {
+			zwidth = width;
+			zheight = height;
+			zbytes = depthFormat == DepthFormat::D16 ? 2 : 4;
+			depthMax = depthFormat == DepthFormat::D16 ? 65535.0f : depthFormat == DepthFormat::D24 ? 16777215.0f : 0.0f;
+			zstride = ((size_t)width*supersampling_n*zbytes + CACHE_LINE_SIZE - 1)/CACHE_LINE_SIZE*CACHE_LINE_SIZE;
+			// over-allocate by a cache line to be able to align the start
+			zstorage.resize(zstride*height + CACHE_LINE_SIZE);
+			size_t misalignment = (size_t)zstorage.data() % CACHE_LINE_SIZE;
+			zbuffer = zstorage.data() + (misalignment ? CACHE_LINE_SIZE - misalignment : 0);
+			hizBlocksX = (width + BLOCK_SIZE - 1)/BLOCK_SIZE;
+			hizMin.resize(hizBlocksX*((height + BLOCK_SIZE - 1)/BLOCK_SIZE));
+			hizMax.resize(hizMin.size());
+			clearDepthBuffer();
+		}
+
+		// Sets every depth in the z-buffer, and the Hi-Z bounds, to the far value.
+		void Rasterizer::clearDepthBuffer() {
+			float far = FLT_MAX;
+			Uint32 pattern = 0xffffffff;
+			if (depthFormat == DepthFormat::D32F)
+				std::memcpy(&pattern, &far, sizeof(pattern));
+			else {
+				far = depthMax;
+				if (depthFormat == DepthFormat::D24)
+					pattern = 0x00ffffff;
+			}
+			Simd::fill32(zbuffer, zstride*zheight, pattern);
+			std::fill(hizMin.begin(), hizMin.end(), far);
+			std::fill(hizMax.begin(), hizMax.end(), far);
 		}
 	}
 }
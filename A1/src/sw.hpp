@@ -1,36 +1,191 @@
 #ifndef SW_HPP
 #define SW_HPP
 
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <map>
+#include <memory>
 #include <SDL2/SDL.h>
 #include <string>
 #include <vector>
 
+#include "framewriter.hpp"
+#include "presenter.hpp"
+#include "threadpool.hpp"
+
 namespace COL781 {
 	namespace Software {
 
 		class Attribs {
 			// A class to contain the attributes of ONE vertex
 		public:
+			// Attribute indices must lie in [0, MAX_ATTRIBS).
+			// The storage is inline, so that creating and copying Attribs never allocates.
+			static const int MAX_ATTRIBS = 16;
+			Attribs() : dims() {}
 			// only float, glm::vec2, glm::vec3, glm::vec4 allowed
 			template <typename T> T get(int attribIndex) const;
 			template <typename T> void set(int attribIndex, T value);
 		private:
-			std::vector<glm::vec4> values;
-			std::vector<int> dims;
+			static bool validIndex(int index);
+			static void checkDimension(int index, int actual, int requested);
+			glm::vec4 values[MAX_ATTRIBS];
+			int dims[MAX_ATTRIBS];
 		};
 
 		class Uniforms {
 			// A class to contain all the uniform variables
+			// Each uniform has a location, an integer that gives the array of its type and its index
+			// there, so that reading or writing it by location takes constant time and never allocates.
 		public:
-			// any type allowed
+			// Locations of the uniforms read by the built-in shaders, which always exist:
+			// "transform" (glm::mat4, initially the identity) and "color" (glm::vec4, initially opaque black).
+			static const int TRANSFORM = 7;   // the first glm::mat4
+			static const int COLOR = 4;       // the first glm::vec4
+			Uniforms();
+			// only float, int, glm::vec2, glm::vec3, glm::vec4, glm::mat2, glm::mat3, glm::mat4 allowed
+			// A location of another type, or -1, reads as zero and is not written.
+			template <typename T> T get(int location) const;
+			template <typename T> void set(int location, T value);
+			// Returns the location of the uniform with the given name, or -1 if there is none.
+			int getLocation(const std::string &name) const;
+			// Access by name: get() throws std::out_of_range if there is no such uniform, and set()
+			// creates it. Setting a uniform with another type replaces it, at a new location.
 			template <typename T> T get(const std::string &name) const;
 			template <typename T> void set(const std::string &name, T value);
 		private:
-			std::map<std::string,void*> values;
+			static const int TYPES = 8;   // location = index*TYPES + type
+			template <typename T> static int type();
+			template <typename T> std::vector<T> &values();
+			template <typename T> const std::vector<T> &values() const;
+			template <typename T> int create(const std::string &name, T value);
+			std::vector<float> floats;
+			std::vector<int> ints;
+			std::vector<glm::vec2> vec2s;
+			std::vector<glm::vec3> vec3s;
+			std::vector<glm::vec4> vec4s;
+			std::vector<glm::mat2> mat2s;
+			std::vector<glm::mat3> mat3s;
+			std::vector<glm::mat4> mat4s;
+			std::map<std::string, int> locations;
 		};
 
+		// The accessors that shaders call are defined here, so that shaders compiled elsewhere (see
+		// Rasterizer::drawObject<VS, FS>()) can inline them.
+
+		inline void Attribs::checkDimension(int index, int actual, int requested) {
+			if (actual != requested) {
+				// std::cout << "Warning: attribute " << index << " has dimension " << actual << " but accessed as dimension " << requested << std::endl;
+			}
+		}
+
+		// Out-of-range attribute indices read as zero and are not written.
+		inline bool Attribs::validIndex(int index) {
+			return index >= 0 && index < MAX_ATTRIBS;
+		}
+
+		template <> inline float Attribs::get(int index) const {
+			if (!validIndex(index))
+				return 0;
+			checkDimension(index, dims[index], 1);
+			return values[index].x;
+		}
+
+		template <> inline glm::vec2 Attribs::get(int index) const {
+			if (!validIndex(index))
+				return glm::vec2(0);
+			checkDimension(index, dims[index], 2);
+			return glm::vec2(values[index].x, values[index].y);
+		}
+
+		template <> inline glm::vec3 Attribs::get(int index) const {
+			if (!validIndex(index))
+				return glm::vec3(0);
+			checkDimension(index, dims[index], 3);
+			return glm::vec3(values[index].x, values[index].y, values[index].z);
+		}
+
+		template <> inline glm::vec4 Attribs::get(int index) const {
+			if (!validIndex(index))
+				return glm::vec4(0);
+			checkDimension(index, dims[index], 4);
+			return values[index];
+		}
+
+		template <> inline void Attribs::set(int index, float value) {
+			if (!validIndex(index))
+				return;
+			dims[index] = 1;
+			values[index].x = value;
+		}
+
+		template <> inline void Attribs::set(int index, glm::vec2 value) {
+			if (!validIndex(index))
+				return;
+			dims[index] = 2;
+			values[index].x = value.x;
+			values[index].y = value.y;
+		}
+
+		template <> inline void Attribs::set(int index, glm::vec3 value) {
+			if (!validIndex(index))
+				return;
+			dims[index] = 3;
+			values[index].x = value.x;
+			values[index].y = value.y;
+			values[index].z = value.z;
+		}
+
+		template <> inline void Attribs::set(int index, glm::vec4 value) {
+			if (!validIndex(index))
+				return;
+			dims[index] = 4;
+			values[index] = value;
+		}
+
+		template <> inline int Uniforms::type<float>() { return 0; }
+		template <> inline int Uniforms::type<int>() { return 1; }
+		template <> inline int Uniforms::type<glm::vec2>() { return 2; }
+		template <> inline int Uniforms::type<glm::vec3>() { return 3; }
+		template <> inline int Uniforms::type<glm::vec4>() { return 4; }
+		template <> inline int Uniforms::type<glm::mat2>() { return 5; }
+		template <> inline int Uniforms::type<glm::mat3>() { return 6; }
+		template <> inline int Uniforms::type<glm::mat4>() { return 7; }
+
+		template <> inline std::vector<float> &Uniforms::values() { return floats; }
+		template <> inline std::vector<int> &Uniforms::values() { return ints; }
+		template <> inline std::vector<glm::vec2> &Uniforms::values() { return vec2s; }
+		template <> inline std::vector<glm::vec3> &Uniforms::values() { return vec3s; }
+		template <> inline std::vector<glm::vec4> &Uniforms::values() { return vec4s; }
+		template <> inline std::vector<glm::mat2> &Uniforms::values() { return mat2s; }
+		template <> inline std::vector<glm::mat3> &Uniforms::values() { return mat3s; }
+		template <> inline std::vector<glm::mat4> &Uniforms::values() { return mat4s; }
+
+		template <> inline const std::vector<float> &Uniforms::values() const { return floats; }
+		template <> inline const std::vector<int> &Uniforms::values() const { return ints; }
+		template <> inline const std::vector<glm::vec2> &Uniforms::values() const { return vec2s; }
+		template <> inline const std::vector<glm::vec3> &Uniforms::values() const { return vec3s; }
+		template <> inline const std::vector<glm::vec4> &Uniforms::values() const { return vec4s; }
+		template <> inline const std::vector<glm::mat2> &Uniforms::values() const { return mat2s; }
+		template <> inline const std::vector<glm::mat3> &Uniforms::values() const { return mat3s; }
+		template <> inline const std::vector<glm::mat4> &Uniforms::values() const { return mat4s; }
+
+		template <typename T> inline T Uniforms::get(int location) const {
+			const std::vector<T> &array = values<T>();
+			size_t index = (size_t)location/TYPES;
+			if (location < 0 || location%TYPES != type<T>() || index >= array.size())
+				return T(0);
+			return array[index];
+		}
+
+		template <typename T> inline void Uniforms::set(int location, T value) {
+			std::vector<T> &array = values<T>();
+			size_t index = (size_t)location/TYPES;
+			if (location < 0 || location%TYPES != type<T>() || index >= array.size())
+				return;
+			array[index] = value;
+		}
+
 
 
 		/* A vertex shader is a function that:
@@ -44,12 +199,68 @@ namespace COL781 {
 		   and returns the colour of the fragment as an RGBA value. */
 		using FragmentShader = glm::vec4(*)(const Uniforms &uniforms, const Attribs &in);
 
-		struct ShaderProgram {
+		// The built-in shaders as functor types, for Rasterizer::drawObject<VS, FS>().
+		// Rasterizer::vsIdentity() etc. return functions that call them.
+
+		struct VSIdentity {
+			glm::vec4 operator()(const Uniforms &uniforms, const Attribs &in, Attribs &out) const {
+				return in.get<glm::vec4>(0);
+			}
+		};
+
+		struct VSTransform {
+			glm::vec4 operator()(const Uniforms &uniforms, const Attribs &in, Attribs &out) const {
+				glm::vec4 vertex = in.get<glm::vec4>(0);
+				glm::mat4 transform = uniforms.get<glm::mat4>(Uniforms::TRANSFORM);
+				return transform * vertex;
+			}
+		};
+
+		struct VSColor {
+			glm::vec4 operator()(const Uniforms &uniforms, const Attribs &in, Attribs &out) const {
+				glm::vec4 vertex = in.get<glm::vec4>(0);
+				glm::vec4 color = in.get<glm::vec4>(1);
+				out.set<glm::vec4>(0, color);
+				return vertex;
+			}
+		};
+
+		struct VSColorTransform {
+			glm::vec4 operator()(const Uniforms &uniforms, const Attribs &in, Attribs &out) const {
+				glm::vec4 vertex = in.get<glm::vec4>(0);
+				glm::vec4 color = in.get<glm::vec4>(1);
+				out.set<glm::vec4>(0, color);
+				glm::mat4 transform = uniforms.get<glm::mat4>(Uniforms::TRANSFORM);
+				return transform * vertex;
+			}
+		};
+
+		struct FSConstant {
+			glm::vec4 operator()(const Uniforms &uniforms, const Attribs &in) const {
+				return uniforms.get<glm::vec4>(Uniforms::COLOR);
+			}
+		};
+
+		struct FSIdentity {
+			glm::vec4 operator()(const Uniforms &uniforms, const Attribs &in) const {
+				return in.get<glm::vec4>(0);
+			}
+		};
+
+		struct Program {
+			// A shader program, owned by the rasterizer that created it
 			VertexShader vs;
 			FragmentShader fs;
 			Uniforms uniforms;
 		};
 
+		struct ShaderProgram {
+			// A handle to a program of the rasterizer, as returned by createShaderProgram().
+			// Copies of a handle refer to the same program.
+			int id;               // index in the rasterizer's programs, or -1
+			ShaderProgram() : id(-1) {}
+		};
+
 		struct Object {
 			using Buffer = std::vector<float>;
 			std::vector<Buffer> attributeValues;
@@ -57,19 +268,298 @@ namespace COL781 {
 			std::vector<glm::ivec3> indices;
 		};
 
+		// Returns the number of complete vertices in the object's attribute arrays.
+		int vertexCount(const Object &object);
+
+		// A side of a triangle, as used by face culling.
+		enum class Face { Front, Back };
+
+		// The order in which a triangle's vertices appear on the screen.
+		enum class Winding { CounterClockwise, Clockwise };
+
+		// Formats of the z-buffer: 16-bit or 24-bit unsigned fixed point over the depth range
+		// (stored in 2 and 4 bytes respectively), or 32-bit float NDC depth.
+		enum class DepthFormat { D16, D24, D32F };
+
+		// Placement of the samples within a pixel when multisampling:
+		// Standard: the usual GPU positions, for 1, 2, 4, 8 or 16 samples per pixel.
+		// OrderedGrid: a regular grid, for 1, 4 or 16 samples per pixel.
+		// RotatedGrid: a grid rotated so that no two samples are level, for 1, 4 or 16 samples per pixel.
+		// Sparse: samples that share no row, column or diagonal of a fine grid, for 1, 4, 8 or 16 samples per pixel.
+		enum class SamplePattern { Standard, OrderedGrid, RotatedGrid, Sparse };
+
+		// The rasterizer works on a fixed-point sub-pixel grid: screen-space vertex positions are
+		// snapped to 1/SUBPIXEL_ONE of a pixel, so that edge functions can be evaluated exactly
+		// (and identically for triangles sharing an edge) with 64-bit integer arithmetic.
+		const int SUBPIXEL_BITS = 8;
+		const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+		// Vertices further than this from the origin (in pixels) cannot be represented.
+		const float MAX_SCREEN_COORD = (float)(1 << 20);
+
+		struct EdgeFunction {
+			// E(x, y) = a*x + b*y + c over fixed-point screen coordinates.
+			// A sample is inside the edge if E >= bias (bias is 0 or 1, see the top-left rule).
+			long long a, b, c;
+			long long bias;
+		};
+
+		// Width in pixels of the guard band around the viewport. Triangles that stay within it
+		// are rasterized without being clipped in x and y; the viewport scissors them instead.
+		const float GUARD_BAND = 4096;
+		// Most vertices a triangle can have after clipping against the near, far and guard-band planes.
+		const int MAX_CLIPPED_VERTICES = 9;
+
+		struct ShadedVertex {
+			// A vertex after the vertex stage
+			glm::vec4 position;   // clip-space position returned by the vertex shader
+			glm::vec4 color;      // fragment shader output for the vertex's attributes
+		};
+
+		struct Plane {
+			// A(i, j) = a*i + b*j + c: an attribute interpolated linearly in screen space,
+			// evaluated at the centre of pixel (i, j).
+			float a, b, c;
+		};
+
+		struct Triangle {
+			// A triangle after setup, ready to be rasterized
+			EdgeFunction edge[3];             // edge[k] is the edge opposite vertex k
+			Plane z;                          // depth, in the units of the z-buffer
+			Plane q;                          // 1/w, for perspective correction
+			Plane col[4];                     // colour components divided by w
+			float z_min, z_max;               // depth range, widened by z_err and stored as the z-buffer would
+			float z_err;                      // bound on the rounding error when evaluating the depth plane
+			int i_min, i_max, j_min, j_max;   // covered pixel range, clipped to the viewport
+		};
+
+		// Size in pixels of the square screen tiles that are rasterized in parallel.
+		const int TILE_SIZE = 64;
+		// Alignment in bytes of the rows of the z-buffer.
+		const int CACHE_LINE_SIZE = 64;
+		// Number of saved frames that can be queued for writing at once.
+		const int FRAME_BUFFERS = 3;
+		// Size in pixels of the blocks that are tested against the triangle edges as a whole.
+		// Must divide TILE_SIZE.
+		const int BLOCK_SIZE = 8;
+		// Largest number of samples per pixel supported by multisampling.
+		const int MAX_SAMPLES = 16;
+
+		struct Stats {
+			// Rasterization work counters, reset at every clear()
+			long long verticesShaded; // vertex shader invocations
+			long long trianglesRejected; // triangles entirely outside the view frustum
+			long long trianglesClipped;  // triangles crossing the near or far plane or the guard band
+			long long trianglesCulled;   // triangles facing the culled side towards the viewer
+			long long blocksTested;   // blocks evaluated against the triangle edges
+			long long blocksAccepted; // blocks found entirely inside a triangle
+			long long pixelsTested;   // pixels whose samples were evaluated against the triangle edges
+			long long pixelsCovered;  // pixels found to have at least one sample inside a triangle
+			long long fragmentsKilledEarly; // covered pixels whose samples all failed the depth test before shading
+			long long trianglesHiZRejected; // triangle/tile pairs skipped as the triangle is behind the whole tile
+			long long blocksHiZRejected;    // blocks skipped as the triangle is behind the whole block
+			long long blocksHiZAccepted;    // blocks shaded without depth compares as the triangle is in front
+			long long fragmentsShaded;      // covered pixels that were shaded and written
+			long long allocations;    // heap allocations made by the whole program (on any thread), or -1 if not counted (see allocationCount())
+			Stats() : verticesShaded(0), trianglesRejected(0), trianglesClipped(0), trianglesCulled(0), blocksTested(0), blocksAccepted(0), pixelsTested(0), pixelsCovered(0), fragmentsKilledEarly(0), trianglesHiZRejected(0), blocksHiZRejected(0), blocksHiZAccepted(0), fragmentsShaded(0), allocations(0) {}
+		};
+
 		class Rasterizer {
 		public:
+			Rasterizer();
+			~Rasterizer();
+			Rasterizer(const Rasterizer&) = delete;
+			Rasterizer &operator=(const Rasterizer&) = delete;
+
 #include "api.inc"
+
+			/** Software-only extensions **/
+
+			// Creates a window with the given title, size, and samples per pixel, placed in the given
+			// pattern. initialize(title, width, height, spp) uses SamplePattern::Standard.
+			bool initialize(const std::string &title, int width, int height, int spp, SamplePattern pattern);
+
+			// Initializes the rasterizer without a window (nor SDL video), to render offscreen into an
+			// RGBA framebuffer of the given size. show() is then optional: it only finishes the frame,
+			// and the result is retrieved with readPixels().
+			bool initializeOffscreen(int width, int height, int spp=1, SamplePattern pattern=SamplePattern::Standard);
+
+			// Copies the width x height pixels with top-left corner (x, y) of the current frame into rgba,
+			// with 4 bytes per pixel in R, G, B, A order, row by row from the top. Returns false, copying
+			// nothing, if the rectangle does not lie within the framebuffer.
+			bool readPixels(int x, int y, int width, int height, Uint8 *rgba);
+
+			// Saves the current frame to the file at path. The frame is copied right away, but encoded
+			// and written on a background thread; up to FRAME_BUFFERS frames can wait to be written
+			// before this blocks.
+			void saveFrame(const std::string &path, ImageFormat format);
+
+			// Saves every frame passed to show() from now on, to files named prefix + a 5-digit frame
+			// number (starting at first) + the extension of the format.
+			void startFrameSequence(const std::string &prefix, ImageFormat format, int first=0);
+			void stopFrameSequence();
+
+			// Waits until every saved frame has been written.
+			void flushFrames();
+
+			// Sets the number of framebuffers that a window's frames are presented from, between 1 and 3.
+			// With 1 (the default), show() presents the frame before returning, and frames are rendered
+			// straight into the window surface when its format allows, with no copy. With 2 (double buffering)
+			// or 3 (triple buffering), show() hands the frame to a present thread and returns, so that the
+			// next frame is rendered while it is presented, at the cost of up to n-1 frames of latency.
+			// Pixels not cleared or drawn in a frame are then undefined, and readPixels() only reads the
+			// current frame before show().
+			void setPresentBuffers(int n);
+
+			// Returns the frame rate and latency of the frames presented to the window since its
+			// framebuffers were (re)created.
+			PresentStats getPresentStats() const;
+
+			// Returns the work counters accumulated since the last clear().
+			Stats getStats() const;
+
+			// Prints the work counters of the current frame to standard output.
+			void printStats() const;
+
+			// Sets the number of threads used to rasterize (0 picks one per hardware thread).
+			// Defaults to one per hardware thread.
+			void setThreadCount(int n);
+
+			// Sets the format of the z-buffer, and clears it. Defaults to DepthFormat::D32F.
+			void setDepthFormat(DepthFormat format);
+
+			// Returns the location of the program's uniform with the given name, or -1 if it has not
+			// been set. Shaders read a uniform by location with uniforms.get<T>(location).
+			int getUniformLocation(const ShaderProgram &program, const std::string &name);
+
+			// Sets the value of the uniform at the given location, without looking up its name.
+			// Does nothing if the location is -1 or belongs to a uniform of another type.
+			template <typename T> void setUniform(ShaderProgram &program, int location, T value);
+
+			// Draws the triangles of the given object like drawObject(object), but with shaders given as
+			// functor types (such as VSColorTransform and FSIdentity) instead of the active program's.
+			// They are called like VertexShader and FragmentShader, with the active program's uniforms,
+			// and are compiled into the vertex loop, where they can be inlined. Draws nothing if no
+			// program is active.
+			template <typename VS, typename FS> void drawObject(const Object &object, const VS &vs = VS(), const FS &fs = FS());
 		private:
-			SDL_Window *window;
-			SDL_Surface *framebuffer;
+			template <typename VS, typename FS> void shadeVertices(const Object &object, const Uniforms &uniforms, const VS &vs, const FS &fs);
+			void drawShaded(const Object &object);
+			bool initializeTarget(int width, int height, int spp, SamplePattern pattern);
+			void rasterizeTile(int k);
+			void rasterizeTriangle(const Triangle &tri, int i_min, int i_max, int j_min, int j_max, Stats &stats);
+			void shadePixel(const Triangle &tri, int i, int j, int coverage, bool depthPass, Stats &stats);
+			void shadeSpan4(const Triangle &tri, int i, int j, int mask, bool depthPass, Stats &stats);
+			void updateHiZ(int bi, int bj);
+			void resizeDepthBuffer(int width, int height);
+			void clearDepthBuffer();
+			void resizeFramebuffer(int width, int height);
+			void fillTile(int t);
+			void resolve();
+			Program *getProgram(const ShaderProgram &program) const;
+			Program *bindProgram(const ShaderProgram &program);
+
+			SDL_Window *window;                   // NULL when rendering offscreen
+			SDL_Surface *framebuffer;             // owned by the presenter, if there is a window
+			std::unique_ptr<Presenter> presenter;
+			Presenter::Clock::time_point frameStart;   // time of the last clear()
 			bool quit;
-			ShaderProgram rasterizerProgram;
+			// Shader programs, indexed by handle. Deleted programs are freed, and their handles are not reused.
+			std::vector<std::unique_ptr<Program>> programs;
+			Program *activeProgram;               // NULL if none
 			int supersampling_n;
-			std::vector<std::vector<float>> zbuffer;
+			// Sample positions relative to the pixel centre, on the fixed-point sub-pixel grid and in pixels
+			std::vector<glm::ivec2> sampleOffsets;
+			std::vector<glm::vec2> samplePositions;
+			glm::ivec2 sampleMin, sampleMax;
+			// With more than one sample per pixel, the colour of sample s of pixel (i, j) is
+			// sampleColors[(i + width*j)*supersampling_n + s]; resolve() averages them into the framebuffer.
+			std::vector<Uint32> sampleColors;
+			// Fast clear: clear() only marks the tiles as pending, and a pending tile is filled with
+			// clearColor when it is first drawn to, or by resolve(). A tile already holding clearColor
+			// is not written at all. Drawn tiles become resolved once resolve() has brought their
+			// pixels up to date with their samples.
+			enum TileState : unsigned char { TILE_DRAWN, TILE_RESOLVED, TILE_PENDING, TILE_CLEAR };
+			std::vector<TileState> tileStates;    // state of each TILE_SIZE x TILE_SIZE tile, in row-major order
+			Uint32 clearColor;                    // packed in the framebuffer's format
+			// Layout of the framebuffer's pixels, resolved when it is created (see Simd::channelLayout())
+			int channelShift[4];
+			Uint32 channelMask[4];
+			// z-buffer: zheight rows of zstride bytes, the depth of sample s of pixel (i, j) at
+			// zbuffer + zstride*j + zbytes*(i*supersampling_n + s).
+			// Every row starts on a cache line of zstorage. Integer formats store NDC depth mapped to
+			// [0, depthMax] and rounded; D32F stores it as is, and has depthMax = 0.
+			std::vector<unsigned char> zstorage;
+			unsigned char *zbuffer;
+			int zwidth, zheight, zbytes;
+			size_t zstride;
+			DepthFormat depthFormat;
+			float depthMax;
 			bool zbuffering;
+			// Hi-Z: bounds of the z-buffer over each BLOCK_SIZE x BLOCK_SIZE block, in row-major order
+			std::vector<float> hizMin, hizMax;
+			int hizBlocksX;
+			bool faceCulling;
+			Face culledFace;
+			Winding frontFace;
+			Stats stats;
+			long long frameAllocations;           // allocationCount() at the last clear()
+			std::unique_ptr<ThreadPool> pool;
+			// per-draw scratch buffers, kept around to avoid reallocating them
+			std::vector<ShadedVertex> shadedVertices;
+			std::vector<Triangle> triangles;
+			std::vector<std::vector<int>> bins;   // triangle indices overlapping each tile
+			std::vector<int> activeTiles;         // tiles with a non-empty bin
+			int tilesX;                           // number of tile columns of the framebuffer
+			// Frame capture: the writer is created by the first saveFrame()
+			std::unique_ptr<FrameWriter> frameWriter;
+			bool sequenceActive;
+			std::string sequencePrefix;
+			ImageFormat sequenceFormat;
+			int sequenceFrame;                    // number of the next frame of the sequence
+			std::vector<Stats> tileStats;
 		};
 
+		template <typename VS, typename FS> void Rasterizer::drawObject(const Object &object, const VS &vs, const FS &fs) {
+			if (activeProgram == NULL)
+				return;
+			shadeVertices(object, activeProgram->uniforms, vs, fs);
+			drawShaded(object);
+		}
+
+		// Geometry: runs the vertex shader (and, for now, the fragment shader) once per vertex,
+		// no matter how many triangles share it, into shadedVertices.
+		// Vertex fetch reads the attribute arrays in place.
+		template <typename VS, typename FS> void Rasterizer::shadeVertices(const Object &object, const Uniforms &uniforms, const VS &vs, const FS &fs) {
+			int n_vertices = vertexCount(object);
+			int n_attribs = std::min((int)object.attributeDims.size(), (int)Attribs::MAX_ATTRIBS);
+			shadedVertices.resize(n_vertices);
+			for (int v = 0; v < n_vertices; v++) {
+				Attribs in;
+				for (int i = 0; i < n_attribs; i++) {
+					int dim = object.attributeDims[i];
+					const float *val = object.attributeValues[i].data() + dim*v;
+					switch (dim) {
+						case 1:
+							in.set(i, val[0]);
+							break;
+						case 2:
+							in.set(i, glm::vec2(val[0], val[1]));
+							break;
+						case 3:
+							in.set(i, glm::vec3(val[0], val[1], val[2]));
+							break;
+						case 4:
+							in.set(i, glm::vec4(val[0], val[1], val[2], val[3]));
+							break;
+					}
+				}
+				Attribs out = in;
+				shadedVertices[v].position = vs(uniforms, in, out);
+				shadedVertices[v].color = fs(uniforms, out);
+			}
+			stats.verticesShaded += n_vertices;
+		}
+
 	}
 }
 
@@ -0,0 +1,72 @@
+#include "threadpool.hpp"
+
+namespace COL781 {
+	namespace Software {
+
+		ThreadPool::ThreadPool(int n) : task(NULL), nTasks(0), next(0), busy(0), batch(0), stopping(false) {
+			for (int i = 1; i < n; i++)
+				workers.push_back(std::thread(&ThreadPool::work, this));
+		}
+
+		ThreadPool::~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (size_t i = 0; i < workers.size(); i++)
+				workers[i].join();
+		}
+
+		int ThreadPool::size() const {
+			return (int)workers.size() + 1;
+		}
+
+		void ThreadPool::run(int n, const std::function<void(int)> &task) {
+			if (workers.empty() || n <= 1) {
+				// not worth waking anyone up
+				for (int i = 0; i < n; i++)
+					task(i);
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				this->task = &task;
+				nTasks = n;
+				next = 0;
+				busy = (int)workers.size();
+				batch++;
+			}
+			wake.notify_all();
+			drain();
+			// every worker must check in before the batch (and `task`) goes out of scope
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]{ return busy == 0; });
+			this->task = NULL;
+		}
+
+		// Executes tasks of the current batch until there are none left.
+		void ThreadPool::drain() {
+			for (int i = next++; i < nTasks; i = next++)
+				(*task)(i);
+		}
+
+		void ThreadPool::work() {
+			unsigned seen = 0;
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [this, seen]{ return stopping || batch != seen; });
+					if (stopping)
+						return;
+					seen = batch;
+				}
+				drain();
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busy == 0)
+					done.notify_one();
+			}
+		}
+
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace COL781 {
+	namespace Software {
+
+		class ThreadPool {
+			// A fixed set of worker threads that execute batches of independent tasks
+		public:
+			// Creates a pool of n threads in total: n-1 workers, plus the thread calling run().
+			explicit ThreadPool(int n);
+			~ThreadPool();
+
+			// Number of threads (including the calling thread) that run() spreads tasks over.
+			int size() const;
+
+			// Calls task(i) for every i in [0, n), in parallel, and returns once all calls have returned.
+			// Tasks are handed out in increasing order of i, but may complete in any order.
+			void run(int n, const std::function<void(int)> &task);
+
+		private:
+			void work();
+			void drain();
+
+			std::vector<std::thread> workers;
+			std::mutex mutex;
+			std::condition_variable wake;       // signalled when a new batch is available
+			std::condition_variable done;       // signalled when the last worker finishes a batch
+			const std::function<void(int)> *task;
+			int nTasks;
+			std::atomic<int> next;              // index of the next task to hand out
+			int busy;                           // workers that have not finished the current batch
+			unsigned batch;                     // incremented for every batch
+			bool stopping;
+		};
+
+	}
+}
+
+#endif